@@ -6,6 +6,12 @@
 #define NES_EMU_CPU_H
 
 #include <MainBus.h>
+#ifdef NES_CPU_TRACE
+#include <CPUTrace.h>
+#endif
+#ifdef NES_CPU_PROFILE
+#include <CPUProfiler.h>
+#endif
 
 //Program Counter
 //
@@ -36,8 +42,16 @@ public:
 
     void Step();
 
+    /* 连续执行指令直到 m_cycles 到达 targetCycle，返回停下时的周期数 */
+    std::uint64_t RunUntil(std::uint64_t targetCycle);
+
     Address GetPC() { return r_PC; }
 
+    std::uint64_t GetCycles() { return m_cycles; }
+
+    /* 距离下一条指令真正执行还需要的周期数，这期间 CPU 不会访问总线 */
+    int GetPendingCycles() { return m_skipCycles > 1 ? m_skipCycles : 1; }
+
     // 仅为测试CPU是否正常工作才开放这个接口
 //    Byte GetACC() { return r_A; }
 
@@ -45,36 +59,172 @@ public:
 
     void Interrupt(InterruptType type);
 
+    /* PRG bank 切换后，$8000-$FFFF 的预解码指令全部作废 */
+    void InvalidateDecodeCache();
+
+    /*
+     * CPU 正在一个只读 RAM/ROM 的空转循环里打转，在下一次中断之前不会访问 I/O，
+     * 这段时间里 CPU 可以落后于 PPU，之后再用 RunUntil 补齐
+    */
+    bool IsIdle() { return m_idleLoop; }
+
+#ifdef NES_CPU_TRACE
+    /* trace 为 nullptr 时停止记录 */
+    void SetTrace(CPUTrace *trace) { m_trace = trace; }
+#endif
+
+#ifdef NES_CPU_PROFILE
+    /* profiler 为 nullptr 时停止统计 */
+    void SetProfiler(CPUProfiler *profiler) { m_profiler = profiler; }
+#endif
+
 private:
     MainBus &m_bus;
 
     /* 内存addr处保存着一个地址信息 */
     Address ReadAddress(Address addr);
 
+    /* 从 r_PC 处读取指令的操作数，同时推进 r_PC */
+    Byte FetchByte();
+
+    Address FetchAddress();
+
+    /* 指令分派表，下标为 opcode */
+    typedef void (CPU::*OpcodeHandler)();
+
+    static const OpcodeHandler s_opcodeTable[0x100];
+
+    /* PRG-ROM ($8000-$FFFF) 中已解码的指令，以 PC 为下标 */
+    enum DecodeState {
+        NotDecoded,
+        Decoded,   /* 向回跳转的指令还没检查过循环体 */
+        LoopIdle,  /* 跳回的循环体没有副作用 */
+        LoopBusy,
+    };
+
+    /*
+     * 每项只有 4 字节，32K 项共 128KB，执行时仍经 s_opcodeTable[opcode] 分派。
+     * 存成员函数指针每项要 24 字节（768KB），比 L2 还大，反而抵消了缓存带来的局部性
+    */
+    struct DecodedInstruction {
+        Byte opcode = 0;
+        Byte operands[2] = {0, 0};
+        Byte state = NotDecoded;
+    };
+    std::vector<DecodedInstruction> m_decodeCache;
+    // 正在执行的指令命中缓存时指向其操作数，否则为 nullptr
+    const Byte *m_prefetched;
+
+    template<Byte opcode>
+    void ExecuteOpcode();
+
     /* 模拟指令执行 */
-    bool ExecuteImplied(Byte opcode);
+    template<Byte opcode>
+    bool ExecuteImplied();
 
-    bool ExecuteBranch(Byte opcode);
+    template<Byte opcode>
+    bool ExecuteBranch();
 
-    bool ExecuteType0(Byte opcode);
+    template<Byte opcode>
+    bool ExecuteType0();
 
-    bool ExecuteType1(Byte opcode);
+    template<Byte opcode>
+    bool ExecuteType1();
 
-    bool ExecuteType2(Byte opcode);
+    template<Byte opcode>
+    bool ExecuteType2();
 
     void SetPageCrossed(Address a, Address b, int inc = 1);
 
+    /* 空转循环检测 */
+    void OnBackwardJump(Address jumpPC, Address target);
+
+    bool IsSideEffectFreeLoop(Address head, Address end);
+
+    int ReadOnlyInstructionLength(Address pc);
+
+    bool m_idleLoop;
+    // 上一次跳回循环头的指令地址以及当时的寄存器快照
+    Address m_idleLoopJump;
+    std::uint64_t m_idleLoopState;
+
+#ifdef NES_CPU_TRACE
+    void TraceInstruction();
+
+    CPUTrace *m_trace = nullptr;
+#endif
+
+#ifdef NES_CPU_PROFILE
+    CPUProfiler *m_profiler = nullptr;
+#endif
+
     /* CPU exec instruction*/
     //* 从内存的栈中读/写数据
     void PushStack(Byte value);
 
     Byte PullStack();
 
-    void SetZN(Byte value);
+    /*
+     * 标志位读写，默认每条指令直接算出标志位。
+     * 定义 NES_LAZY_FLAGS 时 C/Z/N/V 采用惰性求值：只记下最近一次运算的结果，
+     * 等分支、PHP、中断等真正读取时再推导出标志位
+    */
+#ifdef NES_LAZY_FLAGS
+    bool GetC() { return m_carryResult & 0x100; }
+
+    bool GetZ() { return !m_zeroResult; }
+
+    bool GetN() { return m_negativeResult & 0x80; }
+
+    bool GetV() { return m_overflowResult & 0x80; }
+
+    void SetC(bool c) { m_carryResult = c << 8; }
+
+    void SetZ(bool z) { m_zeroResult = !z; }
+
+    void SetN(bool n) { m_negativeResult = n << 7; }
+
+    void SetV(bool v) { m_overflowResult = v << 7; }
+
+    /* C 取 value 的第 8 位 */
+    void SetCarryBit8(std::uint16_t value) { m_carryResult = value; }
+
+    /* V 取 value 的第 7 位 */
+    void SetOverflowBit7(Byte value) { m_overflowResult = value; }
+
+    void SetZN(Byte value) { m_zeroResult = m_negativeResult = value; }
+#else
+    bool GetC() { return f_C; }
+
+    bool GetZ() { return f_Z; }
+
+    bool GetN() { return f_N; }
+
+    bool GetV() { return f_V; }
+
+    void SetC(bool c) { f_C = c; }
+
+    void SetZ(bool z) { f_Z = z; }
+
+    void SetN(bool n) { f_N = n; }
+
+    void SetV(bool v) { f_V = v; }
+
+    void SetCarryBit8(std::uint16_t value) { f_C = value & 0x100; }
+
+    void SetOverflowBit7(Byte value) { f_V = value & 0x80; }
+
+    void SetZN(Byte value) {
+        //如果值为0，设置ZERO标志为1
+        f_Z = !value;
+        //直接取标志位的值
+        f_N = value & 0x80;
+    }
+#endif
 
     //clock
     int m_skipCycles;
-    int m_cycles;
+    std::uint64_t m_cycles;
 
     //Registers
     Address r_PC;    /* Program Counter */ /*存储下一条将要执行的指令的内存地址*/
@@ -99,13 +249,20 @@ private:
 ///  +----------------- Negative Flag
 ///
 
+#ifdef NES_LAZY_FLAGS
+    std::uint16_t m_carryResult;  /* Carry = bit 8 */
+    Byte m_zeroResult;            /* Zero = (m_zeroResult == 0) */
+    Byte m_negativeResult;        /* Negative = bit 7 */
+    Byte m_overflowResult;        /* Overflow = bit 7 */
+#else
     bool f_C;         /* Carry */
     bool f_Z;         /* Zero */
+    bool f_V;         /* Overflow  */
+    bool f_N;         /* Negative */
+#endif
     bool f_I;         /* IRQ disable */
     bool f_B;         /* Brk command */
     bool f_D;         /* Decimal mode */
-    bool f_V;         /* Overflow  */
-    bool f_N;         /* Negative */
 };
 
 #endif //NES_EMU_CPU_H
@@ -149,7 +149,7 @@ enum Operation0 {
  * 每条指令所需要的时钟数量
  * 0代表该指令编码没有使用
 */
-int OperationCycles[0x100] = {
+constexpr int OperationCycles[0x100] = {
         7, 6, 0, 0, 0, 3, 5, 0, 3, 2, 2, 0, 0, 4, 6, 0,
         2, 5, 0, 0, 0, 4, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
         6, 6, 0, 0, 3, 3, 5, 0, 4, 2, 2, 0, 4, 4, 6, 0,
@@ -0,0 +1,45 @@
+#ifndef NES_EMU_CPUPROFILER_H
+#define NES_EMU_CPUPROFILER_H
+
+#include <Chip.h>
+#include <string>
+
+/*
+ * 统计游戏代码的热点，用于寻找可以优化的空转循环和热点函数
+ * 每执行一条指令只做几次计数器自增：
+ *  - 每个 opcode 的执行次数和消耗的周期
+ *  - 单条指令周期数的直方图（DMA 之类特别长的都计入最后一格）
+ *  - 以 16 字节为一个桶的 PC 采样计数
+ * 编译时打开 NES_CPU_PROFILE 才会统计
+*/
+class CPUProfiler {
+public:
+    static const int PCBucketShift = 4;
+    static const int PCBucketCount = 0x10000 >> PCBucketShift;
+    static const int HistogramSize = 17;
+
+    CPUProfiler();
+
+    void Record(Address pc, Byte opcode, int cycles) {
+        ++m_opcodeCounts[opcode];
+        m_opcodeCycles[opcode] += cycles;
+        ++m_cycleHistogram[cycles < HistogramSize - 1 ? cycles : HistogramSize - 1];
+        ++m_pcBuckets[pc >> PCBucketShift];
+    }
+
+    void Reset();
+
+    /* 只导出非零的项 */
+    bool DumpJSON(const std::string &path) const;
+
+    bool DumpCSV(const std::string &path) const;
+
+private:
+    std::uint64_t m_opcodeCounts[0x100];
+    std::uint64_t m_opcodeCycles[0x100];
+    std::uint64_t m_cycleHistogram[HistogramSize];
+    std::uint64_t m_pcBuckets[PCBucketCount];
+};
+
+
+#endif //NES_EMU_CPUPROFILER_H
@@ -0,0 +1,52 @@
+#ifndef NES_EMU_CPUTRACE_H
+#define NES_EMU_CPUTRACE_H
+
+#include <Chip.h>
+#include <string>
+#include <vector>
+
+/*
+ * CPU 指令跟踪
+ * 每执行一条指令写入一条定长的二进制记录到预先分配好的环形缓冲区，缓冲区满后覆盖最旧的记录
+ * 导出的文件用 tools/TraceDecoder.cpp 转成 nestest 格式的文本
+ * 编译时打开 NES_CPU_TRACE 才会记录，关闭时 CPU 中不会有任何跟踪代码
+*/
+
+struct CPUTraceRecord {
+    std::uint64_t cycle;    // 指令开始执行时的 CPU 周期数
+    Address pc;
+    Byte opcode;
+    Byte operands[2];
+    Byte a;
+    Byte x;
+    Byte y;
+    Byte p;
+    Byte sp;
+    Byte reserved[6];
+};
+
+static_assert(sizeof(CPUTraceRecord) == 24, "CPUTraceRecord must stay a fixed 24-byte record");
+
+class CPUTrace {
+public:
+    /* capacity 会向上取整到 2 的幂 */
+    explicit CPUTrace(std::size_t capacity = 1 << 20);
+
+    void Record(const CPUTraceRecord &record) {
+        m_records[m_next & m_mask] = record;
+        ++m_next;
+    }
+
+    /* 按从旧到新的顺序写出缓冲区中的记录 */
+    bool Dump(const std::string &path) const;
+
+    static bool Load(const std::string &path, std::vector<CPUTraceRecord> &records);
+
+private:
+    std::vector<CPUTraceRecord> m_records;
+    std::size_t m_mask;
+    std::uint64_t m_next;
+};
+
+
+#endif //NES_EMU_CPUTRACE_H
@@ -16,6 +16,7 @@
 */
 #include <cstdint>
 #include <vector>
+#include <string>
 
 using Byte = std::uint8_t;
 using Address = std::uint16_t;
@@ -0,0 +1,101 @@
+#ifndef NES_EMU_CONSOLE_H
+#define NES_EMU_CONSOLE_H
+
+#include <CPU.h>
+#include <Cartridge.h>
+#include <MainBus.h>
+#include <Mapper.h>
+#include <PPU.h>
+#include <PictureBus.h>
+#include <Controller.h>
+#include <DeferredRenderer.h>
+#include <memory>
+#include <string>
+
+/*
+ * 模拟核心：CPU、PPU、两条总线、卡带、mapper 和手柄，不依赖任何窗口或图形库。
+ * 前端（SFML 窗口、无界面的命令行）只通过这里加载 ROM、推进时间、送入按键和取画面
+*/
+class Console {
+public:
+    Console();
+
+    /* 加载 ROM 并复位，失败时返回 false。SetRenderThread 要在这之前调用 */
+    bool LoadROM(const std::string &path);
+
+    /* 手柄 1、2 当前的按钮状态，见 Controller::SetButtons */
+    void SetInput(Byte player1, Byte player2 = 0);
+
+    /* 带着这一帧的手柄 1 输入一直跑到 PPU 走完下一帧的可见部分（精确到指令） */
+    void RunFrame(Byte input);
+
+    /* 以 3:1 的比例推进 PPU 与 CPU，共 cycles 个 CPU 周期 */
+    void RunCycles(std::uint64_t cycles);
+
+    /* 每 n 帧只画 1 帧，见 PPU::SetFrameSkip。随时可以改，渲染线程沿用 LoadROM 时的设置 */
+    void SetFrameSkip(int n);
+
+    /* 在工作线程上生成画面，见 DeferredRenderer；卡带不支持时仍在模拟线程上渲染 */
+    void SetRenderThread(bool enabled) { m_renderThread = enabled; }
+
+    /* 画面在工作线程上生成时返回它，否则返回 nullptr，画面直接从下面几个函数取 */
+    DeferredRenderer *GetRenderer() { return m_renderer.get(); }
+
+    /* 最近画完的一帧，按行存放的 6 位调色板下标，见 PPU::GetFrameBuffer */
+    const Byte *GetFrameBuffer() { return m_ppu.GetFrameBuffer(); }
+
+    const std::uint32_t *GetFrameRGBA() { return m_ppu.GetFrameRGBA(); }
+
+    std::uint64_t GetFrameCount() { return m_ppu.GetFrameCount(); }
+
+    const std::vector<FrameRect> &GetDirtyRects() { return m_ppu.GetDirtyRects(); }
+
+    /* 已经走完的帧数，包括跳过没画的帧 */
+    std::uint64_t GetFrameIndex() { return m_ppu.GetFrameIndex(); }
+
+#ifdef NES_CPU_TRACE
+    CPUTrace &GetTrace() { return m_cpuTrace; }
+#endif
+
+#ifdef NES_CPU_PROFILE
+    CPUProfiler &GetProfiler() { return m_cpuProfiler; }
+#endif
+
+private:
+    // 总线要先于绑定它们的 CPU、PPU 构造
+    MainBus m_bus;
+    CPU m_cpu;
+    Cartridge m_cartridge;
+    std::unique_ptr<Mapper> m_mapper;
+    PictureBus m_pictureBus;
+    PPU m_ppu;
+    Controller m_controller1;
+    Controller m_controller2;
+    int m_frameSkip;
+    bool m_renderThread;
+    // 必须在 m_mapper 之前析构
+    std::unique_ptr<DeferredRenderer> m_renderer;
+
+    void DMA(Byte page);
+
+    void Strobe(Byte b);
+
+    /* CPU 空转时只推进 PPU，直到 NMI 把 CPU 叫醒或者到达 target */
+    void RunIdle(std::uint64_t target);
+    // RunIdle 期间 CPU 落后于 PPU，m_deferredCycle 是 PPU 已经跑完的 CPU 周期数
+    bool m_cpuDeferred;
+    std::uint64_t m_deferredCycle;
+    // RunCycles 在 PPU 走完这一帧时提前返回，见 RunFrame
+    std::uint64_t m_frameLimit;
+
+#ifdef NES_CPU_TRACE
+    CPUTrace m_cpuTrace;
+#endif
+
+#ifdef NES_CPU_PROFILE
+    CPUProfiler m_cpuProfiler;
+#endif
+};
+
+
+#endif //NES_EMU_CONSOLE_H
@@ -0,0 +1,40 @@
+#ifndef NES_EMU_CONTROLLER_H
+#define NES_EMU_CONTROLLER_H
+
+#include <Chip.h>
+
+/*
+ * 标准手柄。写 $4016 的第 0 位为 1 时锁存按钮状态，之后每次读 $4016/$4017 按
+ * A、B、Select、Start、上、下、左、右的顺序移出一位，8 位读完之后一直读到 1
+*/
+class Controller {
+public:
+    enum Button {
+        A,
+        B,
+        Select,
+        Start,
+        Up,
+        Down,
+        Left,
+        Right,
+        TotalButtons,
+    };
+
+    Controller();
+
+    void Strobe(Byte b);
+
+    Byte Read();
+
+    /* 第 i 位为 1 表示按下了 Button i */
+    void SetButtons(Byte buttons) { m_buttons = buttons; }
+
+private:
+    bool m_strobe;
+    Byte m_buttons;
+    unsigned int m_keyStates;
+};
+
+
+#endif //NES_EMU_CONTROLLER_H
@@ -0,0 +1,90 @@
+#ifndef NES_EMU_DEFERREDRENDERER_H
+#define NES_EMU_DEFERREDRENDERER_H
+
+#include <PPU.h>
+#include <PictureBus.h>
+#include <Mapper.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * 在工作线程上生成画面。
+ * 模拟线程的 PPU 关闭渲染（PPU::SetRenderEnabled），只负责 vblank、NMI 和 0 号精灵碰撞这些影响 CPU 的时序，
+ * 它的寄存器访问连同发生的点数记录下来，每帧结束后整帧交给这里的另一个 PPU：
+ * 走到同一个点再重放同样的访问，两个 PPU 的状态就完全一致，画出的帧也逐像素相同。
+ *
+ * 两个 PPU 共享同一个 mapper 读 CHR，只能用于运行中 CHR 不会变化的卡带（CHR-ROM 且没有 CHR bank 切换）
+*/
+class DeferredRenderer : public PPUAccessLog {
+public:
+    /* 模拟线程的 PPU 必须刚 Reset 过，之后记录的点数才和这里对得上 */
+    DeferredRenderer(Mapper *mapper, int frameSkip);
+
+    ~DeferredRenderer();
+
+    void Record(Type type, Byte value, std::uint64_t dot) override;
+
+    void RecordDMA(const Byte *page, std::uint64_t dot) override;
+
+    void EndFrame(std::uint64_t dot) override;
+
+    /*
+     * 最近画完的一帧。frame 是调用方已有的帧号，有更新的帧时把它和这一帧的脏矩形复制出来，
+     * 更新 frame 并返回 true
+    */
+    bool GetLatestFrame(std::uint64_t &frame, std::vector<std::uint32_t> &pixels,
+                        std::vector<FrameRect> &dirtyRects);
+
+    /* 等待已经提交的帧全部重放完 */
+    void Flush();
+
+private:
+    struct Access {
+        std::uint64_t dot;
+        Byte type;
+        Byte value;
+    };
+
+    /* 一帧的访问记录，DMA 的 256 字节源数据按顺序放在 dmaPages 里 */
+    struct FrameLog {
+        std::vector<Access> accesses;
+        std::vector<Byte> dmaPages;
+        std::uint64_t endDot = 0;
+    };
+
+    // 模拟线程最多领先的帧数，再多就等工作线程追上
+    static const std::size_t MaxPendingFrames = 3;
+
+    void Worker();
+
+    void Replay(const FrameLog &log);
+
+    void RunTo(std::uint64_t dot);
+
+    PictureBus m_bus;
+    PPU m_ppu;
+
+    // 模拟线程正在记录的一帧，只有模拟线程访问
+    FrameLog m_recording;
+
+    std::mutex m_mutex;
+    std::condition_variable m_submitted;
+    std::condition_variable m_completed;
+    std::deque<FrameLog> m_pending;
+    // 重放完的 FrameLog 留着复用，避免每帧重新分配
+    std::vector<FrameLog> m_recycled;
+    bool m_busy;
+    bool m_stop;
+
+    std::vector<std::uint32_t> m_latestPixels;
+    std::vector<FrameRect> m_latestRects;
+    std::uint64_t m_latestFrame;
+
+    std::thread m_thread;
+};
+
+
+#endif //NES_EMU_DEFERREDRENDERER_H
@@ -5,44 +5,113 @@
 #ifndef NES_EMU_EMULATOR_H
 #define NES_EMU_EMULATOR_H
 
-#include <CPU.h>
-#include <Cartridge.h>
-#include <MainBus.h>
-#include <Mapper.h>
+#include <Console.h>
 #include <SFML/Graphics.hpp>
 #include <VirtualScreen.h>
-#include <PPU.h>
-#include <chrono>
-#include <PictureBus.h>
+#include <FrameScheduler.h>
+#include <FrameTripleBuffer.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <Log.h>
 
 
 const int NESVideoWidth = ScanlineVisibleDots;
 const int NESVideoHeight = VisibleScanlines;
 
+/*
+ * SFML 前端：窗口、键盘和计时，模拟本身都在 Console 里。
+ * SFML 的窗口不是线程安全的：调用 Run 的线程独占窗口，处理事件、读键盘、设置标题、draw 和 display，
+ * 垂直同步的等待也只拖住这个线程。模拟在另一个线程上按 FrameScheduler 的节奏运行，
+ * 画完的帧经 FrameTripleBuffer 交给窗口线程，按键和暂停等状态通过原子变量传过去
+*/
 class Emulator {
 public:
     Emulator();
 
+    ~Emulator();
+
     void Run(std::string rom_path);
 
+    Log &GetLog() { return m_log; }
+
+    /* 每 n 帧只画 1 帧，见 PPU::SetFrameSkip */
+    void SetFrameSkip(int n) {
+        m_frameSkip = n;
+        m_console.SetFrameSkip(n);
+    }
+
+    /* 启动时就进入快进，运行中按 Tab 切换 */
+    void SetFastForward(bool enabled) { m_fastForward = enabled; }
+
+    /* 快进时每 n 帧只显示 1 帧，其余帧 PPU 也不画；比 --frame-skip 小时按 --frame-skip 跳 */
+    void SetFastForwardSkip(int n) { m_fastForwardSkip = std::max(n, 1); }
+
+    /* 在工作线程上生成画面，见 DeferredRenderer；卡带不支持时仍在模拟线程上渲染 */
+    void SetRenderThread(bool enabled) { m_console.SetRenderThread(enabled); }
+
 private:
-    CPU m_cpu;
-    Cartridge m_cartridge;
-    MainBus m_bus;
-    std::unique_ptr<Mapper> m_mapper;
+    // 实例自己的 logger，必须最先构造
+    Log m_log;
+    // 构造期间把 m_log 绑定到当前线程，Console 构造时的错误才能输出；构造函数结束时解除
+    std::unique_ptr<Log::Scope> m_constructionLogScope;
+    Console m_console;
     sf::RenderWindow m_window;
     VirtualScreen m_emulatorScreen;
     // 控制屏幕缩放
     float m_screenScale;
+    // 模拟线程最近一次发布的帧号
+    std::uint64_t m_publishedFrame;
+    FrameTripleBuffer m_frames;
+
+    /* 模拟线程：有新画完的帧时发布给窗口线程，从不等待 */
+    void PublishFrame();
+
+    // 模拟线程
+    std::thread m_emulationThread;
+    std::atomic<bool> m_running;
+    // 窗口线程交给模拟线程的状态：当前按下的键（见 ReadKeyboard）、暂停或失去焦点、暂停时按 F3 单步的次数
+    std::atomic<Byte> m_input;
+    std::atomic<bool> m_paused;
+    std::atomic<int> m_stepRequests;
+#ifdef NES_CPU_PROFILE
+    // 按了 F5，由模拟线程导出，统计数据只有它在写
+    std::atomic<bool> m_dumpProfile;
+#endif
+    // 模拟线程算好的窗口标题，窗口线程取走后清空
+    std::mutex m_titleMutex;
+    std::string m_title;
+    // 最近一次送到屏幕上的帧号，只有窗口线程访问
+    std::uint64_t m_presentedFrame;
+
+    void EmulationLoop();
+
+    void StopEmulation();
+
+    /* 把第 frame 帧送到屏幕，紧接着上次的一帧只更新变化的区域 */
+    void PresentFrame(std::uint64_t frame, const std::uint32_t *pixels, const std::vector<FrameRect> &dirtyRects);
+
+    /* 当前按下的键对应的手柄 1 按钮，见 Controller::SetButtons */
+    Byte ReadKeyboard();
+
+#ifdef NES_CPU_PROFILE
+    void DumpProfile();
+#endif
+
+    // 按 NTSC 帧率逐帧调度，只有模拟线程访问
+    FrameScheduler m_scheduler;
+
+    // 快进：不限速、不等垂直同步。窗口线程按 Tab 切换，两个线程各自应用自己那一半
+    std::atomic<bool> m_fastForward;
+    int m_fastForwardSkip;
+    int m_frameSkip;
 
-    void DMA(Byte page);
-    PPU m_ppu;
-    PictureBus m_pictureBus;
+    void ApplyFastForward(bool fastForward);
 
-    // 计时
-    std::chrono::high_resolution_clock::time_point m_cycleTimer;
-    std::chrono::high_resolution_clock::duration m_elapsedTime;
-    std::chrono::nanoseconds m_cpuCycleDuration;
+    int FastForwardSkip() const { return std::max(m_fastForwardSkip, m_frameSkip); }
 };
 
 
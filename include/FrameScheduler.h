@@ -0,0 +1,63 @@
+#ifndef NES_EMU_FRAMESCHEDULER_H
+#define NES_EMU_FRAMESCHEDULER_H
+
+#include <chrono>
+
+/*
+ * 按帧调度：每跑完并发布一帧调用一次 WaitForNextFrame，睡到下一帧的截止时间。
+ * 截止时间按固定周期从 Reset 开始累加，单帧的睡眠误差不会累积成漂移；
+ * 已经过了截止时间就不再睡，落后太多（暂停、窗口拖动、主机卡顿）时放弃追赶，从当前时间重新开始。
+ * 模拟线程的节奏完全由这里决定，不和显示器同步：垂直同步只让窗口线程等待（见 Emulator），
+ * 它每次刷新取走最新发布的一帧，刷新率与 NES 的帧率不一致时偶尔会重复或跳过一帧
+*/
+class FrameScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /* 最近一个统计周期（约 1 秒）的帧率和帧间隔 */
+    struct Stats {
+        double fps;
+        double emulatedFps;    /* 每秒模拟的帧数，快进时一次显示对应多帧 */
+        double meanFrameTime;  /* 毫秒 */
+        double frameTimeStdDev; /* 毫秒 */
+        int lateFrames;         /* 晚于截止时间超过半帧的帧数 */
+    };
+
+    /* NTSC NES 的帧率 */
+    explicit FrameScheduler(double fps = 60.0988);
+
+    /* 从现在开始重新计时，暂停或失去焦点之后恢复时调用 */
+    void Reset();
+
+    /* 显示的这一帧之前模拟了 emulatedFrames 帧，按调用时的实际值累计，中途改变也不影响统计 */
+    void WaitForNextFrame(int emulatedFrames = 1);
+
+    /* 不限速时 WaitForNextFrame 不再睡眠，只统计帧率；恢复限速时从当前时间重新计时 */
+    void SetUncapped(bool uncapped);
+
+    /* 每个统计周期结束时返回 true 并填写 stats */
+    bool PollStats(Stats &stats);
+
+private:
+    void SleepUntil(Clock::time_point deadline);
+
+    Clock::duration m_period;
+    Clock::time_point m_deadline;
+    Clock::time_point m_lastFrame;
+    // 操作系统睡眠唤醒的延迟估计，睡到截止时间前这么久再自旋等待
+    Clock::duration m_wakeupLatency;
+    bool m_uncapped;
+
+    // 当前统计周期
+    Clock::time_point m_statsStart;
+    int m_frames;
+    long m_emulatedFrames;
+    int m_lateFrames;
+    double m_sum;
+    double m_sumSquares;
+    bool m_statsReady;
+    Stats m_stats;
+};
+
+
+#endif //NES_EMU_FRAMESCHEDULER_H
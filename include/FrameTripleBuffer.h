@@ -0,0 +1,46 @@
+#ifndef NES_EMU_FRAMETRIPLEBUFFER_H
+#define NES_EMU_FRAMETRIPLEBUFFER_H
+
+#include <PPU.h>
+#include <atomic>
+#include <vector>
+
+/*
+ * 模拟线程（唯一的生产者）和显示线程（唯一的消费者）之间交换整帧画面的无锁三缓冲。
+ * 三块缓冲分别归生产者、消费者所有，剩下一块放在中间；交换只是对中间下标的一次原子 exchange，
+ * 双方都不会等待对方：生产者总有一块可写，消费者总能拿到最新画完的一帧，来不及显示的帧直接被覆盖
+*/
+class FrameTripleBuffer {
+public:
+    struct Frame {
+        // PPU 的帧号，消费者据此判断 dirtyRects 是否相对于它上次显示的那一帧
+        std::uint64_t number;
+        std::vector<std::uint32_t> pixels;
+        std::vector<FrameRect> dirtyRects;
+    };
+
+    FrameTripleBuffer();
+
+    /* 生产者：写这一块，写完调用 Publish */
+    Frame &GetBackFrame() { return m_frames[m_back]; }
+
+    void Publish();
+
+    /* 消费者：有新发布的帧时换到前面并返回 true，之后通过 GetFrontFrame 读取 */
+    bool Acquire();
+
+    const Frame &GetFrontFrame() { return m_frames[m_front]; }
+
+private:
+    // m_middle 的低两位是中间那块的下标，FreshBit 表示它是生产者发布之后还没被取走的新帧
+    static const int IndexMask = 0x3;
+    static const int FreshBit = 0x4;
+
+    Frame m_frames[3];
+    std::atomic<int> m_middle;
+    int m_back;
+    int m_front;
+};
+
+
+#endif //NES_EMU_FRAMETRIPLEBUFFER_H
@@ -10,13 +10,10 @@
 #define __FILENAME__ __FILE__
 #endif
 
+// 没有 logger 绑定到当前线程时直接跳过
 #define LOG(level) \
-if (level > Log::get().getLevel()) ; \
-else Log::get().getStream() << '[' << __FILENAME__ << ":" << std::dec << __LINE__ << "] "
-
-#define LOG_CPU \
-if (sn::CpuTrace != sn::Log::get().getLevel()) ; \
-else sn::Log::get().getCpuTraceStream()
+if (!Log::current() || level > Log::current()->getLevel()) ; \
+else Log::current()->getStream() << '[' << __FILENAME__ << ":" << std::dec << __LINE__ << "] "
 
 
 enum Level
@@ -24,26 +21,36 @@ enum Level
     None,
     Error,
     Info,
-    InfoVerbose,
-    CpuTrace
+    InfoVerbose
 };
+// 每个 Emulator 持有自己的 Log，通过 Log::Scope 绑定到运行它的线程上，
+// 多个实例在不同线程上运行时互不干扰
 class Log
 {
 public:
+    Log();
     ~Log();
     void setLogStream(std::ostream& stream);
-    void setCpuTraceStream(std::ostream& stream);
     Log& setLevel(Level level);
     Level getLevel();
 
     std::ostream& getStream();
-    std::ostream& getCpuTraceStream();
 
-    static Log& get();
+    // 当前线程绑定的 logger，没有则为 nullptr
+    static Log* current();
+
+    // 在作用域内把 log 绑定为当前线程的 logger，离开时恢复之前的绑定
+    class Scope
+    {
+    public:
+        explicit Scope(Log& log);
+        ~Scope();
+    private:
+        Log* m_previous;
+    };
 private:
     Level m_logLevel;
     std::ostream* m_logStream;
-    std::ostream* m_cpuTrace;
 };
 
 //Courtesy of http://wordaligned.org/articles/cpp-streambufs#toctee-streams
@@ -9,12 +9,13 @@
 #include <Cartridge.h>
 #include <Mapper.h>
 #include <vector>
-#include <map>
 
 /*
  * IO寄存器的具体含义参考 http://fms.komkon.org/EMUL8/NES.html#LABF
 */
 
+class PPU;
+
 enum IORegisters {
     PPUCTRL = 0x2000,  // 控制寄存器
     PPUMASK,
@@ -39,28 +40,78 @@ public:
 
     Byte Read(Address addr);
 
+    /* 只读取普通内存，I/O 等有副作用的地址返回 0，供调试跟踪使用 */
+    Byte Peek(Address addr);
+
     void Write(Address addr, Byte val);
 
     bool SetMapper(Mapper *mapper);
 
+    /* mapper 切换 PRG bank 后重新填写 $8000-$FFFF 的页表项 */
+    void UpdatePRGPages();
+
     const Byte *GetPagePtr(Byte page);
 
-    // IO 寄存器读写
+    /* $2000-$3FFF 的 PPU 寄存器按 addr & 7 直接调用 ppu 的成员函数，不经过下面的回调表 */
+    bool SetPPU(PPU *ppu);
+
+    // $4000-$401F 的 IO 寄存器读写
     // 为什么不直接采用普通内存读写的实现？
     // 提供一个抽象接口，交由对应的硬件模块提供函数获得相应的寄存器值
-    bool SetWriteCallback(IORegisters reg, std::function<void(Byte)> callback);
+    // 回调在编译期绑定到具体的成员函数，例如 SetReadCallback<Controller, &Controller::Read>(JOY1, &controller)
+    template<typename T, void (T::*Method)(Byte)>
+    bool SetWriteCallback(IORegisters reg, T *object) {
+        return SetWriteHandler(reg, object, &WriteThunk<T, Method>);
+    }
 
-    bool SetReadCallback(IORegisters reg, std::function<Byte(void)> callback);
+    template<typename T, Byte (T::*Method)()>
+    bool SetReadCallback(IORegisters reg, T *object) {
+        return SetReadHandler(reg, object, &ReadThunk<T, Method>);
+    }
 
 private:
+    struct WriteHandler {
+        void *object;
+        void (*call)(void *, Byte);
+    };
+
+    struct ReadHandler {
+        void *object;
+        Byte (*call)(void *);
+    };
+
+    template<typename T, void (T::*Method)(Byte)>
+    static void WriteThunk(void *object, Byte value) {
+        (static_cast<T *>(object)->*Method)(value);
+    }
+
+    template<typename T, Byte (T::*Method)()>
+    static Byte ReadThunk(void *object) {
+        return (static_cast<T *>(object)->*Method)();
+    }
+
+    bool SetWriteHandler(IORegisters reg, void *object, void (*call)(void *, Byte));
+
+    bool SetReadHandler(IORegisters reg, void *object, Byte (*call)(void *));
+
+    Byte ReadSlow(Address addr);
+
+    void WriteSlow(Address addr, Byte value);
+
     //内存信息
     std::vector<Byte> m_RAM;
     //扩展内存
     std::vector<Byte> m_extRAM;
 //    Cartridge cartridge;
     Mapper *m_mapper;
-    std::map<IORegisters, std::function<void(Byte)>> m_writeCallbacks;
-    std::map<IORegisters, std::function<Byte(void)>> m_readCallbacks;
+    PPU *m_ppu;
+    // 以 addr & 0x1f 为下标
+    WriteHandler m_writeHandlers[0x20];
+    ReadHandler m_readHandlers[0x20];
+
+    // 以 256 字节为一页，每页直接指向宿主内存，nullptr 表示需要走慢速路径
+    const Byte *m_readPages[0x100];
+    Byte *m_writePages[0x100];
 };
 
 
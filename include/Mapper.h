@@ -7,6 +7,7 @@
 
 #include <Cartridge.h>
 #include <functional>
+#include <memory>
 
 enum NameTableMirroring {
     Horizontal = 0,
@@ -29,7 +30,7 @@ public:
         CNROM = 3,
     };
 
-    Mapper(Cartridge &cart, Type t) : m_cartridge(cart), m_type(t) {};
+    Mapper(Cartridge &cart, Type t) : m_cartridge(cart), m_type(t), m_patternCache(2 * PatternRows * 8) {};
 
     /* 虚函数 */
     //PRG Program, CHR Pattern, PRG/CHR可能有多个Bank， CPU/PPU通过Mapper访问PRG和CHR数据
@@ -41,6 +42,19 @@ public:
 
     virtual Byte ReadCHR(Address addr) = 0;
 
+    /* 返回 addr 所在 256 字节 PRG 页的宿主内存指针，读有副作用的页返回 nullptr */
+    virtual const Byte *GetPRGPagePtr(Address) {
+        return nullptr;
+    }
+
+    /*
+     * 预解码的图案表：addr 所在的 tile 行已经把低/高两个平面合成 8 个 2 bit 像素下标，
+     * 第 i 个元素就是从左数第 i 个像素，flip 为 true 时返回水平翻转后的一行
+    */
+    const Byte *GetPatternRow(Address addr, bool flip) {
+        return &m_patternCache[(flip * PatternRows + PatternRowIndex(addr)) * 8];
+    }
+
     //默认有实现，非纯虚函数，不用 '= 0'
     virtual NameTableMirroring GetNameTableMirroring();
 
@@ -48,6 +62,11 @@ public:
         return m_cartridge.HasExtendedRAM();
     }
 
+    /* 切换 PRG bank 的 mapper 需要在切换后调用此回调，使 CPU 缓存的已解码指令失效 */
+    void SetPRGBankCallback(std::function<void(void)> cb) {
+        m_prgBankCallback = cb;
+    }
+
     /*mirroring_cb 可选回调函数*/
     //std::unique_ptr<Mapper> 表示一个智能指针，用于管理 Mapper 对象的生命周期。
     //它提供了自动释放内存的功能，当该 std::unique_ptr 被销毁时，它会自动调用析构函数来销毁所管理的 Mapper 对象。这样可以方便地管理动态分配的 Mapper 对象，避免手动释放内存和内存泄漏的风险。
@@ -66,8 +85,27 @@ public:
 
 
 protected:
+    /* 8KB 的图案表共 512 个 tile，每个 tile 8 行 */
+    static const int PatternRows = 0x2000 / 16 * 8;
+
+    static int PatternRowIndex(Address addr) {
+        return ((addr & 0x1ff0) >> 1) | (addr & 0x7);
+    }
+
+    /* CHR 内容改变（加载、CHR-RAM 写入、切换 CHR bank）后，重新展开受影响的行 */
+    void UpdatePatternRow(Address addr);
+
+    void UpdatePatternCache();
+
+    void OnPRGBankSwitch() {
+        if (m_prgBankCallback)
+            m_prgBankCallback();
+    }
+
     Cartridge &m_cartridge;
     Type m_type;
+    std::function<void(void)> m_prgBankCallback;
+    std::vector<Byte> m_patternCache;
 };
 
 
@@ -16,6 +16,8 @@ public:
 
     Byte ReadPRG(Address addr);
 
+    const Byte *GetPRGPagePtr(Address addr);
+
     Byte ReadCHR(Address addr);
 
     void WriteCHR(Address addr, Byte value);
@@ -7,7 +7,7 @@
 
 #include <Chip.h>
 #include <PictureBus.h>
-#include <VirtualScreen.h>
+#include <functional>
 #include <vector>
 
 const int ScanlineCycleLength = 341;
@@ -17,10 +17,46 @@ const int ScanlineVisibleDots = 256;
 const int VisibleScanlines = 240;
 const int FrameEndScanline = 261;
 const int AttributeOffset = 0x3C0;
+const int FramePixels = ScanlineVisibleDots * VisibleScanlines;
+
+/* 画面上以像素为单位的矩形区域 */
+struct FrameRect {
+    int x, y, width, height;
+};
+
+/*
+ * 会改变 PPU 状态的寄存器访问的记录接口（见 DeferredRenderer）。
+ * dot 是访问发生时 PPU 已经走过的点数，另一个 PPU 走到同一个点再重放同样的访问，状态就完全一致
+*/
+class PPUAccessLog {
+public:
+    enum Type {
+        Control,
+        Mask,
+        OAMAddress,
+        OAMData,
+        Scroll,
+        DataAddress,
+        Data,
+        ReadStatus, /* 读 $2002 会清掉写入锁存 */
+        ReadData,   /* 读 $2007 会推进 VRAM 地址 */
+        DMA,        /* 由 RecordDMA 记录 */
+    };
+
+    virtual void Record(Type type, Byte value, std::uint64_t dot) = 0;
+
+    /* OAM DMA，page 是 256 字节的源数据 */
+    virtual void RecordDMA(const Byte *page, std::uint64_t dot) = 0;
+
+    /* 一帧的可见部分结束（PostRender 的最后一个点） */
+    virtual void EndFrame(std::uint64_t dot) = 0;
+
+    virtual ~PPUAccessLog() = default;
+};
 
 class PPU {
 public:
-    PPU(PictureBus &bus, VirtualScreen &screen);
+    PPU(PictureBus &bus);
 
     void Reset();
 
@@ -52,6 +88,51 @@ public:
 
     void DoDMA(const Byte *page_ptr);
 
+    /*
+     * 最近画完的一帧，按行连续存放，每个像素 1 字节，是 6 bit 的系统调色板下标，
+     * 下标为 y * ScanlineVisibleDots + x，在下一帧画完（进入 vblank 前后缓冲交换）之前内容不变
+    */
+    const Byte *GetFrameBuffer() { return m_frontBuffer; }
+
+    /*
+     * 同一帧转换成 RGBA 像素，布局与 GetFrameBuffer 相同，颜色强调（PPUMASK bit 5-7）在这里按行生效。
+     * 每个像素在内存中依次是 R、G、B、A 四个字节，即 sf::Texture::update 要的格式，不是 0xRRGGBBAA 整数
+    */
+    const std::uint32_t *GetFrameRGBA();
+
+    /* 已经画完的帧数，可用来判断前缓冲是否有新内容 */
+    std::uint64_t GetFrameCount() { return m_frameCount; }
+
+    /*
+     * 最近一帧与上一次画出的帧相比发生变化的区域，由变化的 8x8 tile 合并成矩形，
+     * 第一帧整个画面都算变化。只有在没有漏掉中间帧（帧号正好加 1）时才能只更新这些区域
+    */
+    const std::vector<FrameRect> &GetDirtyRects() { return m_dirtyRects; }
+
+    bool IsFrameUnchanged() { return m_dirtyRects.empty(); }
+
+    /*
+     * 每 n 帧只画 1 帧（n <= 1 时每帧都画）。跳过的帧照常推进时序、vblank/NMI、滚动寄存器和 0 号精灵碰撞，
+     * 只省掉调色板查找和写 picture 缓存，游戏逻辑与全部画出时完全一致。
+     * 从调用之后的下一帧起每 n 帧分成一组，画的是每组的最后一帧，一次连续跑完 n 帧时前缓冲里正好是最新的一帧
+    */
+    void SetFrameSkip(int n) {
+        m_frameSkip = n;
+        m_frameSkipStart = m_frameIndex;
+    }
+
+    /* 关闭后每一帧都按跳过的帧处理，只保留时序和 0 号精灵碰撞，画面由别的 PPU 重放访问记录生成 */
+    void SetRenderEnabled(bool enabled) { m_renderEnabled = enabled; }
+
+    /* 记录之后所有会改变状态的寄存器访问，nullptr 时停止记录 */
+    void SetAccessLog(PPUAccessLog *log) { m_accessLog = log; }
+
+    /* Reset 以来走完可见部分的帧数，跳过的帧和关闭渲染时也计数 */
+    std::uint64_t GetFrameIndex() { return m_frameIndex; }
+
+    /* Reset 以来走过的点数 */
+    std::uint64_t GetDotCount() { return m_dotCount; }
+
 private:
     Byte Read(Address addr);
 
@@ -59,12 +140,51 @@ private:
 
     void WriteOAM(Byte addr, Byte value);
 
+    /* 寄存器访问前把本行推迟的像素补画到当前点 */
+    void CatchUpScanline();
+
+    void FetchTile();
+
+    void RenderDot(int x);
+
+    void RenderScanline();
+
+    void IncrementCoarseX();
+
+    bool SpriteZeroHitPossible();
+
+    /* 前后缓冲交换后，逐个 tile 比较新的一帧和上一帧 */
+    void UpdateDirtyRects();
+
+    bool TileChanged(int tileX, int tileY);
+
+    void AddDirtyRect(int x, int y, int width);
+
+    void DrawPixel(int x, Byte bgColor, bool bgOpaque);
+
+    void BuildSpriteLine();
+
     PictureBus &m_bus;
-    VirtualScreen &m_screen;
 
     std::vector<Byte> m_spriteMemory;
     std::vector<Byte> m_scanlineSprites;
 
+    /*
+     * 本行的精灵像素，0 表示没有不透明的精灵，
+     * 否则低 5 位是调色板地址，另外两位标记精灵在背景后面和 0 号精灵
+    */
+    enum SpriteLineFlags {
+        SpriteBehindBackground = 0x20,
+        SpriteZero = 0x40,
+    };
+    Byte m_spriteLine[ScanlineVisibleDots];
+    bool m_spriteLineValid;
+
+    // 背景 tile 锁存：预解码的图案行、属性给出的调色板高两位，以及锁存时的 m_dataAddress（-1 表示失效）
+    const Byte *m_tilePattern;
+    Byte m_tilePalette;
+    int m_tileAddress;
+
     enum PipelineState {
         PreRender,
         Render,
@@ -75,6 +195,10 @@ private:
     int m_cycle;
     int m_scanline;
     bool m_evenFrame;
+    std::uint64_t m_dotCount;
+    PPUAccessLog *m_accessLog;
+    // 当前行的像素还没有画，留到行末整行渲染
+    bool m_lineDeferred;
 
     bool m_vblank;
     bool m_sprZeroHit;
@@ -92,7 +216,8 @@ private:
     // Flags and variables
     bool m_longSprites;
     bool m_generateInterrupt;
-    bool m_greyscaleMode;
+    Byte m_greyscaleMask;  /* 写入 picture 缓存前与调色板下标相与 */
+    Byte m_emphasis;       /* PPUMASK bit 5-7 */
     bool m_showSprites;
     bool m_showBackground;
     bool m_hideEdgeSprites;
@@ -102,12 +227,38 @@ private:
         Low,
         High,
     } m_bgPage, m_sprPage;
-    std::vector<std::vector<sf::Color>> m_pictureBuffer;
 
     Address m_dataAddrIncrement;
 
-    // 存颜色的vector 的 vector
-    // picture 缓存
+    // picture 缓存：前缓冲是完整的上一帧，后缓冲正在画
+    static const int FrameBufferAlignment = 64;
+    std::vector<Byte> m_frameStorage;
+    Byte *m_frontBuffer;
+    Byte *m_backBuffer;
+    std::uint64_t m_frameCount;
+
+    // 每一行画完时的颜色强调位，随前后缓冲一起交换
+    std::vector<Byte> m_emphasisStorage;
+    Byte *m_frontEmphasis;
+    Byte *m_backEmphasis;
+    // 8 种强调组合各一张 64 色的查找表，字节顺序与 GetFrameRGBA 相同
+    std::vector<std::uint32_t> m_palettes;
+
+    // 跳帧
+    int m_frameSkip;
+    bool m_renderEnabled;
+    std::uint64_t m_frameIndex;
+    // 跳帧分组从这一帧开始
+    std::uint64_t m_frameSkipStart;
+    bool m_skipFrame;
+
+    // 帧间差异，后缓冲里还没有有效的上一帧时整帧算作变化
+    std::vector<FrameRect> m_dirtyRects;
+    bool m_previousFrameValid;
+
+    // GetFrameRGBA 的结果以及它对应的帧号
+    std::vector<std::uint32_t> m_rgbaFrame;
+    std::uint64_t m_rgbaFrameCount;
 };
 
 
@@ -21,6 +21,11 @@ public:
 
     bool SetMapper(Mapper *mapper);
 
+    /* 预解码的图案表行，见 Mapper::GetPatternRow */
+    const Byte *GetPatternRow(Address addr, bool flip) {
+        return m_mapper->GetPatternRow(addr, flip);
+    }
+
     /* 读调色板 */
     Byte ReadPalette(Byte paletteAddr);
 
@@ -6,21 +6,30 @@
 #define NES_EMU_VIRTUALSCREEN_H
 
 #include <SFML/Graphics.hpp>
+#include <cstdint>
+#include <vector>
 
+/*
+ * 整个屏幕是一张 width x height 的纹理，按 pixel_size 缩放后作为一个矩形画出来。
+ * 更新像素只上传变化的区域，画的时候不再提交逐像素的顶点
+*/
 class VirtualScreen : public sf::Drawable {
 public:
     void Create(unsigned int width, unsigned int height, float pixel_size, sf::Color color);
 
-    void SetPixel(std::size_t x, std::size_t y, sf::Color color);
+    /* 用一整帧按行存放的 RGBA 像素（PPU::GetFrameRGBA）更新屏幕 */
+    void SetFrame(const std::uint32_t *pixels);
+
+    /* 只更新从第 y 行开始的 height 行，pixels 仍是整帧；这几行在内存里是连续的，直接上传不复制 */
+    void SetRows(const std::uint32_t *pixels, std::size_t y, std::size_t height);
 
 private:
     void draw(sf::RenderTarget &target, sf::RenderStates states) const;
 
     // unsigned vector
     sf::Vector2u m_screenSize;
-    float m_pixelSize;
-    // 顶点 class
-    sf::VertexArray m_vertices;
+    sf::Texture m_texture;
+    sf::Sprite m_sprite;
 };
 
 
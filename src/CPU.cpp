@@ -2,6 +2,7 @@
 // Created by lai leon on 9/6/2023.
 //
 #include <ios>
+#include <algorithm>
 #include <CPU.h>
 #include <CPUOpcodes.h>
 #include <Log.h>
@@ -39,7 +40,33 @@ const auto OVERFLOW1 = 0b01000000; //0x40
 const auto NEGATIVE = 0b10000000; //0x80
 
 /* CPU 6502 */
-CPU::CPU(MainBus &mem) : m_bus(mem) {}
+CPU::CPU(MainBus &mem) :
+        m_bus(mem),
+        m_decodeCache(0x8000),
+        m_prefetched(nullptr),
+        m_idleLoop(false),
+        m_idleLoopJump(0),
+        m_idleLoopState(0) {}
+
+/* 读取指令流中的下一个字节：命中指令缓存时直接取预解码的操作数 */
+Byte CPU::FetchByte() {
+    if (m_prefetched) {
+        ++r_PC;
+        return *m_prefetched++;
+    }
+    return m_bus.Read(r_PC++);
+}
+
+Address CPU::FetchAddress() {
+    Byte low = FetchByte();
+    return low | FetchByte() << 8;
+}
+
+void CPU::InvalidateDecodeCache() {
+    std::fill(m_decodeCache.begin(), m_decodeCache.end(), DecodedInstruction());
+    m_idleLoop = false;
+    m_idleLoopJump = 0;
+}
 
 Address CPU::ReadAddress(Address addr) {
 //    将两个字节的数据合并成一个 16 位的值，其中高字节位于高位，低字节位于低位
@@ -51,10 +78,15 @@ void CPU::Reset() {
 }
 
 void CPU::Reset(Address start_addr) {
+    InvalidateDecodeCache();
     m_skipCycles = m_cycles = 0;
     r_A = r_X = r_Y = 0;
     f_I = true;
-    f_C = f_D = f_N = f_V = f_Z = false;
+    f_D = false;
+    SetC(false);
+    SetZ(false);
+    SetN(false);
+    SetV(false);
     r_PC = start_addr;
     /* Sp start at 0xfd */
     // 初始Stack Pointer位置, 6502栈是向下增长的
@@ -73,6 +105,10 @@ void CPU::Step() {
         return;
 
     m_skipCycles = 0;
+#ifdef NES_CPU_TRACE
+    if (m_trace)
+        TraceInstruction();
+#endif
     /* 生成程序状态字 */
     /*
     int psw =   f_N << 7 |
@@ -83,29 +119,85 @@ void CPU::Step() {
                 f_Z << 1 |
                 f_C;
     */
-    static Byte opcode = 0;
-    static Byte lastOpcode = opcode;
-    opcode = m_bus.Read(r_PC++);
-    auto CycleLength = OperationCycles[opcode];
-//    if (lastOpcode != opcode) {
-//        LOG(Info) << "CPU Step, PC is 0x"
-//                  << std::hex
-//                  << static_cast<int>(GetPC())
-//                  << "\t opcode is:"
-//                  << std::hex
-//                  << static_cast<int>(opcode)
-//                  << "\t CycleLength is " << CycleLength
-//                  << std::endl;
-//    }
-
-    if (CycleLength && (ExecuteImplied(opcode) || ExecuteBranch(opcode) ||
-                        ExecuteType1(opcode) || ExecuteType2(opcode) || ExecuteType0(opcode))) {
-        m_skipCycles += CycleLength;
+#ifdef NES_CPU_PROFILE
+    Address pc = r_PC;
+#endif
+    Byte opcode;
+    // ROM 区的指令已经预先解码过，直接取缓存中的 opcode 和操作数，不再经过总线
+    if (r_PC >= 0x8000 && r_PC <= 0xfffd) {
+        auto &entry = m_decodeCache[r_PC - 0x8000];
+        if (entry.state == NotDecoded) {
+            entry.opcode = m_bus.Read(r_PC);
+            entry.operands[0] = m_bus.Read(r_PC + 1);
+            entry.operands[1] = m_bus.Read(r_PC + 2);
+            entry.state = Decoded;
+        }
+        opcode = entry.opcode;
+        ++r_PC;
+        m_prefetched = entry.operands;
+        (this->*s_opcodeTable[opcode])();
+        m_prefetched = nullptr;
+    } else {
+        opcode = m_bus.Read(r_PC++);
+
+        // 一次间接跳转直接进入该 opcode 在编译期特化好的执行函数
+        (this->*s_opcodeTable[opcode])();
+    }
+#ifdef NES_CPU_PROFILE
+    // 此时 m_skipCycles 正好是这条指令消耗的周期数（含跨页、分支和 DMA）
+    if (m_profiler)
+        m_profiler->Record(pc, opcode, m_skipCycles);
+#endif
+}
+
+/*
+ * 与逐周期调用 Step 的结果完全一致：等待上一条指令剩余周期时直接把 m_cycles 往前拨，
+ * 只有轮到新指令时才真正调用 Step
+*/
+std::uint64_t CPU::RunUntil(std::uint64_t targetCycle) {
+    while (m_cycles < targetCycle) {
+        if (m_skipCycles > 1) {
+            auto idle = std::min<std::uint64_t>(m_skipCycles - 1, targetCycle - m_cycles);
+            m_cycles += idle;
+            m_skipCycles -= idle;
+        } else {
+            Step();
+        }
+    }
+    return m_cycles;
+}
+
+/*
+ * 每个 opcode 的执行函数在编译期展开：opcode 是模板参数，
+ * ExecuteImplied/ExecuteBranch/ExecuteType0~2 中对寻址方式和操作的 switch 都会被常量折叠，
+ * 原先运行时逐个尝试的判断链只剩下真正匹配的那一段代码
+*/
+template<Byte opcode>
+void CPU::ExecuteOpcode() {
+    if (OperationCycles[opcode] && (ExecuteImplied<opcode>() || ExecuteBranch<opcode>() ||
+                                    ExecuteType1<opcode>() || ExecuteType2<opcode>() || ExecuteType0<opcode>())) {
+        m_skipCycles += OperationCycles[opcode];
     } else {
         // LOG(Error) << "Unrecognized opcode: " << std::hex << +opcode << std::endl;
     }
 }
 
+// 与 OperationCycles 相同的 16x16 布局
+#define OPCODE_ROW(hi) \
+    &CPU::ExecuteOpcode<hi | 0x0>, &CPU::ExecuteOpcode<hi | 0x1>, &CPU::ExecuteOpcode<hi | 0x2>, &CPU::ExecuteOpcode<hi | 0x3>, \
+    &CPU::ExecuteOpcode<hi | 0x4>, &CPU::ExecuteOpcode<hi | 0x5>, &CPU::ExecuteOpcode<hi | 0x6>, &CPU::ExecuteOpcode<hi | 0x7>, \
+    &CPU::ExecuteOpcode<hi | 0x8>, &CPU::ExecuteOpcode<hi | 0x9>, &CPU::ExecuteOpcode<hi | 0xa>, &CPU::ExecuteOpcode<hi | 0xb>, \
+    &CPU::ExecuteOpcode<hi | 0xc>, &CPU::ExecuteOpcode<hi | 0xd>, &CPU::ExecuteOpcode<hi | 0xe>, &CPU::ExecuteOpcode<hi | 0xf>
+
+const CPU::OpcodeHandler CPU::s_opcodeTable[0x100] = {
+        OPCODE_ROW(0x00), OPCODE_ROW(0x10), OPCODE_ROW(0x20), OPCODE_ROW(0x30),
+        OPCODE_ROW(0x40), OPCODE_ROW(0x50), OPCODE_ROW(0x60), OPCODE_ROW(0x70),
+        OPCODE_ROW(0x80), OPCODE_ROW(0x90), OPCODE_ROW(0xa0), OPCODE_ROW(0xb0),
+        OPCODE_ROW(0xc0), OPCODE_ROW(0xd0), OPCODE_ROW(0xe0), OPCODE_ROW(0xf0),
+};
+
+#undef OPCODE_ROW
+
 //r_SP 范围 00～ff 1111 1111
 void CPU::PushStack(Byte val) {
     m_bus.Write(0x100 | --r_SP, val);
@@ -123,6 +215,10 @@ void CPU::Interrupt(InterruptType type) {
     if (f_I && type != NMI && type != BRK_)
         return;
 
+    // 中断处理程序可能改写循环读取的 RAM，之后要重新确认
+    m_idleLoop = false;
+    m_idleLoopJump = 0;
+
     if (type == BRK_) //Add one if BRK, a quirk of 6502
         ++r_PC;
 
@@ -130,14 +226,14 @@ void CPU::Interrupt(InterruptType type) {
     PushStack(r_PC >> 8);
     PushStack(r_PC);
 
-    Byte flags = f_N << 7 |
-                 f_V << 6 |
+    Byte flags = GetN() << 7 |
+                 GetV() << 6 |
                  1 << 5 | //unused bit, supposed to be always 1
                  (type == BRK_) << 4 | //B flag set if BRK
                  f_D << 3 |
                  f_I << 2 |
-                 f_Z << 1 |
-                 f_C;
+                 GetZ() << 1 |
+                 GetC();
     // 保存状态
     PushStack(flags);
 
@@ -157,7 +253,8 @@ void CPU::Interrupt(InterruptType type) {
     m_skipCycles += 7;
 }
 
-bool CPU::ExecuteImplied(Byte opcode) {
+template<Byte opcode>
+bool CPU::ExecuteImplied() {
     switch (static_cast<OperationImplied>(opcode)) {
         case NOP:
             //no operation
@@ -170,7 +267,7 @@ bool CPU::ExecuteImplied(Byte opcode) {
             PushStack(static_cast<Byte>((r_PC + 1) >> 8));
             PushStack(static_cast<Byte>((r_PC + 1)));
             //Jump to New Location
-            r_PC = ReadAddress(r_PC);
+            r_PC = FetchAddress();
             break;
         case RTI:
             //Return from Interrupt
@@ -178,12 +275,12 @@ bool CPU::ExecuteImplied(Byte opcode) {
             //Then PC is pulled from the stack.
         {
             Byte flags = PullStack();
-            f_N = flags & NEGATIVE;
-            f_V = flags & OVERFLOW1;
+            SetN(flags & NEGATIVE);
+            SetV(flags & OVERFLOW1);
             f_D = flags & DECIMAL_MODE;
             f_I = flags & INTERRUPT_DISABLE;
-            f_Z = flags & ZERO;
-            f_C = flags & CARRY;
+            SetZ(flags & ZERO);
+            SetC(flags & CARRY);
         }
             r_PC = PullStack();
             r_PC |= PullStack() << 8;
@@ -194,12 +291,16 @@ bool CPU::ExecuteImplied(Byte opcode) {
             r_PC |= PullStack() << 8;
             ++r_PC;
             break;
-        case JMP:
+        case JMP: {
             //Jump to New Location
-            r_PC = ReadAddress(r_PC);
+            Address jumpPC = r_PC - 1;
+            r_PC = FetchAddress();
+            if (m_prefetched && r_PC <= jumpPC)
+                OnBackwardJump(jumpPC, r_PC);
             break;
+        }
         case JMPI: {
-            Address location = ReadAddress(r_PC);
+            Address location = FetchAddress();
             //6502 has a bug such that the when the vector of anindirect address begins at the last byte of a page,
             //the second byte is fetched from the beginning of that page rather than the beginning of the next
             //Recreating here:
@@ -213,14 +314,14 @@ bool CPU::ExecuteImplied(Byte opcode) {
             //Push Processor Status on Stack
             //The status register will be pushed with the break flag and bit 5 set to 1.
         {
-            Byte flags = f_N << 7 |
-                         f_V << 6 |
+            Byte flags = GetN() << 7 |
+                         GetV() << 6 |
                          1 << 5 | //supposed to always be 1
                          1 << 4 | //PHP pushes with the B flag as 1, no matter what
                          f_D << 3 |
                          f_I << 2 |
-                         f_Z << 1 |
-                         f_C;
+                         GetZ() << 1 |
+                         GetC();
             PushStack(flags);
         }
             break;
@@ -229,12 +330,12 @@ bool CPU::ExecuteImplied(Byte opcode) {
             // The status register will be pulled with the break flag and bit 5 ignored.
         {
             Byte flags = PullStack();
-            f_N = flags & NEGATIVE;
-            f_V = flags & OVERFLOW1;
+            SetN(flags & NEGATIVE);
+            SetV(flags & OVERFLOW1);
             f_D = flags & DECIMAL_MODE;
             f_I = flags & INTERRUPT_DISABLE;
-            f_Z = flags & ZERO;
-            f_C = flags & CARRY;
+            SetZ(flags & ZERO);
+            SetC(flags & CARRY);
         }
             break;
         case PHA:
@@ -268,10 +369,10 @@ bool CPU::ExecuteImplied(Byte opcode) {
             break;
         case CLC:
             // Clear Carry Flag
-            f_C = false;
+            SetC(false);
             break;
         case SEC:
-            f_C = true;
+            SetC(true);
             break;
         case CLI:
             // Clear Interrupt Disable Bit
@@ -286,7 +387,7 @@ bool CPU::ExecuteImplied(Byte opcode) {
             SetZN(r_A);
             break;
         case CLV:
-            f_V = false;
+            SetV(false);
             break;
         case CLD:
             f_D = false;
@@ -324,7 +425,8 @@ bool CPU::ExecuteImplied(Byte opcode) {
 //10	carry
 //11	zero
 
-bool CPU::ExecuteBranch(Byte opcode) {
+template<Byte opcode>
+bool CPU::ExecuteBranch() {
     // 跳转指令实现
     if ((opcode & BranchInstructionMask) == BranchInstructionMaskResult) {
         //branch is initialized to the condition required (for the flag specified later)
@@ -338,26 +440,28 @@ bool CPU::ExecuteBranch(Byte opcode) {
                 // 在马里奥游戏中前二十条指令存在 LDA 2020 , BPL 0xFB指令
                 // 0xF8 解释为 -5，LDA指令为4字长，所以PC会再次跳转到 LDA 2002上
                 // 也就是说必须等待PPU为vblank时才开始执行下一条指令
-                branch = !(branch ^ f_N);
+                branch = !(branch ^ GetN());
                 break;
             case Overflow:
-                branch = !(branch ^ f_V);
+                branch = !(branch ^ GetV());
                 break;
             case Carry:
-                branch = !(branch ^ f_C);
+                branch = !(branch ^ GetC());
                 break;
             case Zero:
-                branch = !(branch ^ f_Z);
+                branch = !(branch ^ GetZ());
                 break;
             default:
                 return false;
         }
 
         if (branch) {
-            int8_t offset = m_bus.Read(r_PC++);
+            int8_t offset = FetchByte();
             ++m_skipCycles;
             auto newPC = static_cast<Address>(r_PC + offset);
             SetPageCrossed(r_PC, newPC, 2);
+            if (m_prefetched && newPC < r_PC)
+                OnBackwardJump(r_PC - 2, newPC);
             r_PC = newPC;
         } else
             ++r_PC;
@@ -369,7 +473,8 @@ bool CPU::ExecuteBranch(Byte opcode) {
 //the cc = 00 instructions
 //https://happysoul.github.io/nes/6502/
 //https://www.masswerk.at/6502/6502_instruction_set.html
-bool CPU::ExecuteType0(Byte opcode) {
+template<Byte opcode>
+bool CPU::ExecuteType0() {
     if ((opcode & InstructionModeMask) == 0x0) {
         //先寻址
         Address location = 0;
@@ -382,21 +487,19 @@ bool CPU::ExecuteType0(Byte opcode) {
                 location = r_PC++;
                 break;
             case ZeroPage_:
-                location = m_bus.Read(r_PC++);
+                location = FetchByte();
                 break;
             case Accumulator_:
                 break;
             case Absolute_:
-                location = ReadAddress(r_PC);
-                r_PC += 2;
+                location = FetchAddress();
                 break;
             case ZeroPageX_:
                 // Address wraps around in the zero page
-                location = (m_bus.Read(r_PC++) + r_X) & 0xff;
+                location = (FetchByte() + r_X) & 0xff;
                 break;
             case AbsoluteX_:
-                location = ReadAddress(r_PC);
-                r_PC += 2;
+                location = FetchAddress();
                 SetPageCrossed(location, location + r_X);
                 location += r_X;
                 break;
@@ -411,9 +514,9 @@ bool CPU::ExecuteType0(Byte opcode) {
                 // bits 7 and 6 of operand are transfered to bit 7 and 6 of SR (N,V);
                 // the zero-flag is set to the result of operand AND accumulator.
                 operand = m_bus.Read(location);
-                f_Z = !(r_A & operand);
-                f_V = operand & OVERFLOW1;
-                f_N = operand & NEGATIVE;
+                SetZ(!(r_A & operand));
+                SetV(operand & OVERFLOW1);
+                SetN(operand & NEGATIVE);
                 break;
             case STY:
                 m_bus.Write(location, r_Y);
@@ -424,13 +527,15 @@ bool CPU::ExecuteType0(Byte opcode) {
                 break;
             case CPY: {
                 std::uint16_t diff = r_Y - m_bus.Read(location);
-                f_C = !(diff & 0x100);
+                //借位时第 8 位为 1，C 为其取反
+                SetCarryBit8(diff ^ 0x100);
                 SetZN(diff);
             }
                 break;
             case CPX: {
                 std::uint16_t diff = r_X - m_bus.Read(location);
-                f_C = !(diff & 0x100);
+                //借位时第 8 位为 1，C 为其取反
+                SetCarryBit8(diff ^ 0x100);
                 SetZN(diff);
             }
                 break;
@@ -444,7 +549,8 @@ bool CPU::ExecuteType0(Byte opcode) {
 }
 
 //the cc = 01 instructions
-bool CPU::ExecuteType1(Byte opcode) {
+template<Byte opcode>
+bool CPU::ExecuteType1() {
     if ((opcode & InstructionModeMask) == 0x1) {
         //first 寻址
         Address location = 0;
@@ -454,23 +560,22 @@ bool CPU::ExecuteType1(Byte opcode) {
                 (opcode & AddrModeMask) >> AddrModeShift)) {
 
             case ZeroPageX0: {
-                Byte zero_addr = r_X + m_bus.Read(r_PC++);
+                Byte zero_addr = r_X + FetchByte();
                 //Addresses wrap in zero page mode, thus pass through a mask
                 location = m_bus.Read(zero_addr & 0xff) | m_bus.Read((zero_addr + 1) & 0xff) << 8;
             }
                 break;
             case ZeroPage:
-                location = m_bus.Read(r_PC++);
+                location = FetchByte();
                 break;
             case Immediate:
                 location = r_PC++;
                 break;
             case Absolute:
-                location = ReadAddress(r_PC);
-                r_PC += 2;
+                location = FetchAddress();
                 break;
             case ZeroPageY: {
-                Byte zero_addr = m_bus.Read(r_PC++);
+                Byte zero_addr = FetchByte();
                 location = m_bus.Read(zero_addr & 0xff) | m_bus.Read((zero_addr + 1) & 0xff) << 8;
                 if (op != STA)
                     SetPageCrossed(location, location + r_Y);
@@ -479,18 +584,16 @@ bool CPU::ExecuteType1(Byte opcode) {
                 break;
             case ZeroPageX:
                 // Address wraps around in the zero page
-                location = (m_bus.Read(r_PC++) + r_X) & 0xff;
+                location = (FetchByte() + r_X) & 0xff;
                 break;
             case AbsoluteY:
-                location = ReadAddress(r_PC);
-                r_PC += 2;
+                location = FetchAddress();
                 if (op != STA)
                     SetPageCrossed(location, location + r_Y);
                 location += r_Y;
                 break;
             case AbsoluteX:
-                location = ReadAddress(r_PC);
-                r_PC += 2;
+                location = FetchAddress();
                 if (op != STA)
                     SetPageCrossed(location, location + r_X);
                 location += r_X;
@@ -515,12 +618,12 @@ bool CPU::ExecuteType1(Byte opcode) {
                 break;
             case ADC: {
                 Byte operand = m_bus.Read(location);
-                std::uint16_t sum = r_A + operand + f_C;
+                std::uint16_t sum = r_A + operand + GetC();
                 //Carry forward or UNSIGNED overflow
-                f_C = sum & 0x100;
+                SetCarryBit8(sum);
                 //SIGNED overflow, would only happen if the sign of sum is
                 //different from BOTH the operands
-                f_V = (r_A ^ sum) & (operand ^ sum) & NEGATIVE;
+                SetOverflowBit7((r_A ^ sum) & (operand ^ sum));
                 r_A = static_cast<Byte>(sum);
                 SetZN(r_A);
             }
@@ -541,7 +644,8 @@ bool CPU::ExecuteType1(Byte opcode) {
                 break;
             case CMP: {
                 std::uint16_t diff = r_A - m_bus.Read(location);
-                f_C = !(diff & 0x100);
+                //借位时第 8 位为 1，C 为其取反
+                SetCarryBit8(diff ^ 0x100);
                 SetZN(diff);
             }
                 break;
@@ -550,12 +654,13 @@ bool CPU::ExecuteType1(Byte opcode) {
             {
                 //High carry means "no borrow", thus negate and subtract
                 std::uint16_t subtrahend = m_bus.Read(location);
-                std::uint16_t diff = r_A - subtrahend - !f_C;
+                std::uint16_t diff = r_A - subtrahend - !GetC();
                 //if the ninth bit is 1, the resulting number is negative => borrow => low carry
-                f_C = !(diff & 0x100);
+                //借位时第 8 位为 1，C 为其取反
+                SetCarryBit8(diff ^ 0x100);
                 //Same as ADC, except instead of the subtrahend,
                 //substitute with it's one complement
-                f_V = (r_A ^ diff) & (~subtrahend ^ diff) & NEGATIVE;
+                SetOverflowBit7((r_A ^ diff) & (~subtrahend ^ diff));
                 r_A = diff;
                 SetZN(diff);
             }
@@ -569,7 +674,8 @@ bool CPU::ExecuteType1(Byte opcode) {
 }
 
 //the cc = 10 instructions
-bool CPU::ExecuteType2(Byte opcode) {
+template<Byte opcode>
+bool CPU::ExecuteType2() {
     if ((opcode & InstructionModeMask) == 0x2) {
         //first 寻址
         Address location = 0;
@@ -581,18 +687,17 @@ bool CPU::ExecuteType2(Byte opcode) {
                 location = r_PC++;
                 break;
             case ZeroPage_:
-                location = m_bus.Read(r_PC++);
+                location = FetchByte();
                 break;
             case Accumulator_:
                 break;
             case Absolute_:
-                location = ReadAddress(r_PC);
-                r_PC += 2;
+                location = FetchAddress();
                 break;
             case ZeroPageX_:
                 // Address wraps around in the zero page
             {
-                location = m_bus.Read(r_PC++);
+                location = FetchByte();
                 Byte index;
                 if (op == LDX || op == STX)
                     index = r_Y;
@@ -603,8 +708,7 @@ bool CPU::ExecuteType2(Byte opcode) {
             }
                 break;
             case AbsoluteX_: {
-                location = ReadAddress(r_PC);
-                r_PC += 2;
+                location = FetchAddress();
                 Byte index;
                 if (op == LDX || op == STX)
                     index = r_Y;
@@ -625,9 +729,9 @@ bool CPU::ExecuteType2(Byte opcode) {
                 if (addr_mode == Accumulator_) {
                     //update r_A
                     //将当前的进位标志位 (f_C) 保存到变量 prev_C 中
-                    auto prev_C = f_C;
+                    auto prev_C = GetC();
                     //将进位标志位 (f_C) 设置为寄存器 A 的最高位 (bit 7)
-                    f_C = r_A & NEGATIVE;
+                    SetC(r_A & NEGATIVE);
                     //将寄存器 A 左移一位，相当于将其每个位向左移动一位，最低位 (bit 0) 填充为 0
                     r_A <<= 1;
                     //如果操作 (op) 是循环左移 (ROL)，将最低位 (bit 0) 设置为先前保存的进位标志位 (prev_C) 的值。
@@ -636,9 +740,9 @@ bool CPU::ExecuteType2(Byte opcode) {
                     SetZN(r_A);
                 } else {
                     //update operand
-                    auto prev_C = f_C;
+                    auto prev_C = GetC();
                     operand = m_bus.Read(location);
-                    f_C = operand & NEGATIVE;
+                    SetC(operand & NEGATIVE);
                     operand = operand << 1 | (prev_C && (op == ROL));
                     SetZN(operand);
                     m_bus.Write(location, operand);
@@ -648,17 +752,17 @@ bool CPU::ExecuteType2(Byte opcode) {
             case ROR:
                 if (addr_mode == Accumulator_) {
                     //update r_A
-                    auto prev_C = f_C;
-                    f_C = r_A & CARRY;
+                    auto prev_C = GetC();
+                    SetC(r_A & CARRY);
                     r_A >>= 1;
                     //If Rotating, set the bit-7 to the previous carry
                     r_A = r_A | (prev_C && (op == ROR)) << 7;
                     SetZN(r_A);
                 } else {
                     //update operand
-                    auto prev_C = f_C;
+                    auto prev_C = GetC();
                     operand = m_bus.Read(location);
-                    f_C = operand & CARRY;
+                    SetC(operand & CARRY);
                     operand = operand >> 1 | (prev_C && (op == ROL)) << 7;
                     SetZN(operand);
                     m_bus.Write(location, operand);
@@ -691,6 +795,30 @@ bool CPU::ExecuteType2(Byte opcode) {
     return false;
 }
 
+#ifdef NES_CPU_TRACE
+/* 记录即将执行的指令和执行前的寄存器状态，指令字节用 Peek 读取，不触发 I/O 副作用 */
+void CPU::TraceInstruction() {
+    CPUTraceRecord record = CPUTraceRecord();
+    record.cycle = m_cycles;
+    record.pc = r_PC;
+    record.opcode = m_bus.Peek(r_PC);
+    record.operands[0] = m_bus.Peek(r_PC + 1);
+    record.operands[1] = m_bus.Peek(r_PC + 2);
+    record.a = r_A;
+    record.x = r_X;
+    record.y = r_Y;
+    record.p = GetN() << 7 |
+               GetV() << 6 |
+               1 << 5 |
+               f_D << 3 |
+               f_I << 2 |
+               GetZ() << 1 |
+               GetC();
+    record.sp = r_SP;
+    m_trace->Record(record);
+}
+#endif
+
 void CPU::SetPageCrossed(Address a, Address b, int inc) {
     //Page is determined by the high byte
     if ((a & 0xFF00) != (b & 0xFF00)) {
@@ -698,9 +826,134 @@ void CPU::SetPageCrossed(Address a, Address b, int inc) {
     }
 }
 
-void CPU::SetZN(Byte value) {
-    //如果值为0，设置ZERO标志为1
-    f_Z = !value;
-    //直接取标志位的值
-    f_N = value & NEGATIVE;
+
+/*
+ * 跳回循环头时检查 CPU 是否进入了空转循环（典型的就是等待 NMI 的 JMP *）：
+ * 循环体只读 RAM/ROM、不写内存、不碰 I/O，并且完整跑完一圈后寄存器和标志位都没变，
+ * 那么之后每一圈都完全一样，只有中断能让 CPU 离开
+*/
+void CPU::OnBackwardJump(Address jumpPC, Address target) {
+    auto &entry = m_decodeCache[jumpPC - 0x8000];
+    if (entry.state == Decoded)
+        entry.state = IsSideEffectFreeLoop(target, jumpPC) ? LoopIdle : LoopBusy;
+    if (entry.state != LoopIdle)
+        return;
+
+    Byte flags = GetN() << 7 | GetV() << 6 | f_D << 3 | f_I << 2 | GetZ() << 1 | GetC();
+    std::uint64_t state = r_A | r_X << 8 | r_Y << 16 | std::uint64_t(r_SP) << 24 | std::uint64_t(flags) << 32;
+    // 循环体中间没有跳出去的分支，两次跳回之间一定是从循环头开始的完整一圈
+    m_idleLoop = m_idleLoopJump == jumpPC && m_idleLoopState == state;
+    m_idleLoopJump = jumpPC;
+    m_idleLoopState = state;
+}
+
+/* [head, end] 是否是一段只在内部跳转、没有任何副作用的 ROM 代码，end 是跳回 head 的指令 */
+bool CPU::IsSideEffectFreeLoop(Address head, Address end) {
+    // RAM 里的代码随时可能被改写
+    if (head < 0x8000 || head > end)
+        return false;
+
+    int pc = head;
+    while (pc < end) {
+        auto opcode = m_bus.Peek(pc);
+        int length;
+        if (opcode == JMP) {
+            Address target = m_bus.Peek(pc + 1) | m_bus.Peek(pc + 2) << 8;
+            if (target < head || target > end)
+                return false;
+            length = 3;
+        } else if ((opcode & BranchInstructionMask) == BranchInstructionMaskResult) {
+            int target = pc + 2 + static_cast<int8_t>(m_bus.Peek(pc + 1));
+            if (target < head || target > end)
+                return false;
+            length = 2;
+        } else {
+            length = ReadOnlyInstructionLength(pc);
+            if (!length)
+                return false;
+        }
+        pc += length;
+    }
+    // end 必须正好落在指令边界上
+    return pc == end;
+}
+
+/* 只读取寄存器、立即数或者 RAM/ROM 的指令返回其长度，其余（写内存、栈操作、I/O 等）返回 0 */
+int CPU::ReadOnlyInstructionLength(Address pc) {
+    auto opcode = m_bus.Peek(pc);
+    switch (opcode) {
+        case NOP:
+        case DEY:
+        case DEX:
+        case TAY:
+        case INY:
+        case INX:
+        case CLC:
+        case SEC:
+        case TYA:
+        case CLV:
+        case CLD:
+        case SED:
+        case TXA:
+        case TAX:
+        case TSX:
+            return 1;
+        case JSR:
+        case RTI:
+        case RTS:
+        case JMPI:
+        case PHP:
+        case PLP:
+        case PHA:
+        case PLA:
+        case CLI:
+        case SEI:
+        case TXS:
+            return 0;
+        default:
+            break;
+    }
+    if (!OperationCycles[opcode] || !opcode)
+        return 0;
+
+    auto op = (opcode & OperationMask) >> OperationShift;
+    auto mode = (opcode & AddrModeMask) >> AddrModeShift;
+    bool zeroPage, absolute;
+    switch (opcode & InstructionModeMask) {
+        case 0x1:
+            if (op == STA)
+                return 0;
+            if (mode == Immediate)
+                return 2;
+            zeroPage = mode == ZeroPage;
+            absolute = mode == Absolute;
+            break;
+        case 0x2:
+            if (mode == Accumulator_ && op < STX)
+                return 1;
+            if (op != LDX)
+                return 0;
+            if (mode == Immediate_)
+                return 2;
+            zeroPage = mode == ZeroPage_;
+            absolute = mode == Absolute_;
+            break;
+        case 0x0:
+            if (op != BIT && op != LDY && op != CPY && op != CPX)
+                return 0;
+            if (mode == Immediate_)
+                return 2;
+            zeroPage = mode == ZeroPage_;
+            absolute = mode == Absolute_;
+            break;
+        default:
+            return 0;
+    }
+    if (zeroPage)
+        return 2;
+    if (!absolute)
+        return 0;
+    // 变址寻址的地址随寄存器变化，这里只接受固定地址，且不能落在 I/O 或卡带 RAM 上
+    Address location = m_bus.Peek(pc + 1) | m_bus.Peek(pc + 2) << 8;
+    return location < 0x2000 || location >= 0x8000 ? 3 : 0;
 }
@@ -0,0 +1,82 @@
+#include <CPUProfiler.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+
+CPUProfiler::CPUProfiler() {
+    Reset();
+}
+
+void CPUProfiler::Reset() {
+    std::fill(std::begin(m_opcodeCounts), std::end(m_opcodeCounts), 0);
+    std::fill(std::begin(m_opcodeCycles), std::end(m_opcodeCycles), 0);
+    std::fill(std::begin(m_cycleHistogram), std::end(m_cycleHistogram), 0);
+    std::fill(std::begin(m_pcBuckets), std::end(m_pcBuckets), 0);
+}
+
+bool CPUProfiler::DumpJSON(const std::string &path) const {
+    std::ofstream file(path);
+    if (!file)
+        return false;
+
+    file << std::uppercase << std::setfill('0');
+    file << "{\n  \"opcodes\": [";
+    const char *separator = "\n";
+    for (int op = 0; op < 0x100; ++op) {
+        if (!m_opcodeCounts[op])
+            continue;
+        file << separator << "    {\"opcode\": \"" << std::hex << std::setw(2) << op << std::dec
+             << "\", \"count\": " << m_opcodeCounts[op]
+             << ", \"cycles\": " << m_opcodeCycles[op] << "}";
+        separator = ",\n";
+    }
+
+    file << "\n  ],\n  \"cycle_histogram\": {";
+    separator = "\n";
+    for (int cycles = 0; cycles < HistogramSize; ++cycles) {
+        if (!m_cycleHistogram[cycles])
+            continue;
+        file << separator << "    \"" << cycles << (cycles == HistogramSize - 1 ? "+" : "")
+             << "\": " << m_cycleHistogram[cycles];
+        separator = ",\n";
+    }
+
+    file << "\n  },\n  \"pc_bucket_size\": " << (1 << PCBucketShift) << ",\n  \"pc_buckets\": [";
+    separator = "\n";
+    for (int bucket = 0; bucket < PCBucketCount; ++bucket) {
+        if (!m_pcBuckets[bucket])
+            continue;
+        file << separator << "    {\"pc\": \"" << std::hex << std::setw(4) << (bucket << PCBucketShift) << std::dec
+             << "\", \"count\": " << m_pcBuckets[bucket] << "}";
+        separator = ",\n";
+    }
+    file << "\n  ]\n}\n";
+    return static_cast<bool>(file);
+}
+
+/* 每行：类别,键,次数,周期 */
+bool CPUProfiler::DumpCSV(const std::string &path) const {
+    std::ofstream file(path);
+    if (!file)
+        return false;
+
+    file << std::uppercase << std::setfill('0');
+    file << "section,key,count,cycles\n";
+    for (int op = 0; op < 0x100; ++op) {
+        if (m_opcodeCounts[op])
+            file << "opcode," << std::hex << std::setw(2) << op << std::dec << ','
+                 << m_opcodeCounts[op] << ',' << m_opcodeCycles[op] << '\n';
+    }
+    for (int cycles = 0; cycles < HistogramSize; ++cycles) {
+        if (m_cycleHistogram[cycles])
+            file << "cycle_histogram," << cycles << (cycles == HistogramSize - 1 ? "+" : "") << ','
+                 << m_cycleHistogram[cycles] << ",\n";
+    }
+    for (int bucket = 0; bucket < PCBucketCount; ++bucket) {
+        if (m_pcBuckets[bucket])
+            file << "pc_bucket," << std::hex << std::setw(4) << (bucket << PCBucketShift) << std::dec << ','
+                 << m_pcBuckets[bucket] << ",\n";
+    }
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,60 @@
+#include <CPUTrace.h>
+#include <cstring>
+#include <fstream>
+
+/*
+ * 文件格式：
+ * |magic "NESTRACE"|记录大小 uint32|记录条数 uint64|记录...|
+*/
+namespace {
+    const char TraceMagic[8] = {'N', 'E', 'S', 'T', 'R', 'A', 'C', 'E'};
+}
+
+CPUTrace::CPUTrace(std::size_t capacity) :
+        m_mask(0),
+        m_next(0) {
+    std::size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+    m_records.resize(size, CPUTraceRecord());
+    m_mask = size - 1;
+}
+
+bool CPUTrace::Dump(const std::string &path) const {
+    std::ofstream file(path, std::ios_base::binary | std::ios_base::out);
+    if (!file)
+        return false;
+
+    std::uint32_t recordSize = sizeof(CPUTraceRecord);
+    std::uint64_t count = m_next < m_records.size() ? m_next : m_records.size();
+    file.write(TraceMagic, sizeof(TraceMagic));
+    file.write(reinterpret_cast<const char *>(&recordSize), sizeof(recordSize));
+    file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+
+    for (std::uint64_t i = m_next - count; i < m_next; ++i) {
+        file.write(reinterpret_cast<const char *>(&m_records[i & m_mask]), sizeof(CPUTraceRecord));
+    }
+    return static_cast<bool>(file);
+}
+
+bool CPUTrace::Load(const std::string &path, std::vector<CPUTraceRecord> &records) {
+    std::ifstream file(path, std::ios_base::binary | std::ios_base::in);
+    if (!file)
+        return false;
+
+    char magic[sizeof(TraceMagic)];
+    std::uint32_t recordSize = 0;
+    std::uint64_t count = 0;
+    if (!file.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, TraceMagic, sizeof(TraceMagic)) != 0 ||
+        !file.read(reinterpret_cast<char *>(&recordSize), sizeof(recordSize)) ||
+        recordSize != sizeof(CPUTraceRecord) ||
+        !file.read(reinterpret_cast<char *>(&count), sizeof(count))) {
+        return false;
+    }
+
+    records.resize(count);
+    if (count && !file.read(reinterpret_cast<char *>(&records[0]), count * sizeof(CPUTraceRecord)))
+        return false;
+    return true;
+}
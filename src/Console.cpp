@@ -0,0 +1,143 @@
+#include <Console.h>
+#include <Log.h>
+#include <algorithm>
+
+Console::Console() :
+        m_cpu(m_bus),
+        m_ppu(m_pictureBus),
+        m_frameSkip(1),
+        m_renderThread(false),
+        m_cpuDeferred(false),
+        m_deferredCycle(0),
+        m_frameLimit(~std::uint64_t(0)) {
+    if (!m_bus.SetPPU(&m_ppu) ||
+        !m_bus.SetReadCallback<Controller, &Controller::Read>(JOY1, &m_controller1) ||
+        !m_bus.SetReadCallback<Controller, &Controller::Read>(JOY2, &m_controller2)) {
+        LOG(Error) << "Critical error: Failed to set I/O callbacks" << std::endl;
+    }
+
+    if (!m_bus.SetWriteCallback<Console, &Console::DMA>(OAMDMA, this) ||
+        !m_bus.SetWriteCallback<Console, &Console::Strobe>(JOY1, this)) {
+        LOG(Error) << "Critical error: Failed to set I/O callbacks" << std::endl;
+    }
+    // ppu 设置中断回调函数
+    m_ppu.SetInterruptCallback([&]() {
+        // CPU 落后于 PPU 时先补齐到当前周期之前，中断才会落在正确的指令边界上
+        if (m_cpuDeferred)
+            m_cpu.RunUntil(m_deferredCycle);
+        m_cpu.Interrupt(CPU::NMI);
+    });
+}
+
+bool Console::LoadROM(const std::string &path) {
+    if (!m_cartridge.LoadFromFile(path)) {
+        LOG(Error) << "Unable to load ROM from file:" << path << std::endl;
+        return false;
+    }
+
+    m_renderer.reset();
+    m_mapper = Mapper::CreateMapper(static_cast<Mapper::Type>(m_cartridge.GetMapper()),
+                                    m_cartridge);
+
+    if (!m_mapper) {
+        LOG(Error) << "Creating Mapper failed. Probably unsupported." << std::endl;
+        return false;
+    }
+    if (!m_bus.SetMapper(m_mapper.get()) ||
+        !m_pictureBus.SetMapper(m_mapper.get())) {
+        return false;
+    }
+
+    // NROM 没有 bank 切换，之后支持的 mapper 切换 PRG bank 时更新总线页表并清空 CPU 的指令缓存
+    m_mapper->SetPRGBankCallback([&]() {
+        m_bus.UpdatePRGPages();
+        m_cpu.InvalidateDecodeCache();
+    });
+
+    m_cpu.Reset();
+    m_ppu.Reset();
+    m_ppu.SetRenderEnabled(true);
+    m_ppu.SetAccessLog(nullptr);
+    // 画面交给工作线程时两个 PPU 共享 mapper，CHR-RAM 会在重放落后的时候被模拟线程改写
+    if (m_renderThread) {
+        if (m_cartridge.GetVROM().empty()) {
+            LOG(Info) << "CHR-RAM cartridge, rendering on the emulation thread" << std::endl;
+        } else {
+            m_renderer.reset(new DeferredRenderer(m_mapper.get(), m_frameSkip));
+            m_ppu.SetRenderEnabled(false);
+            m_ppu.SetAccessLog(m_renderer.get());
+        }
+    }
+#ifdef NES_CPU_TRACE
+    m_cpu.SetTrace(&m_cpuTrace);
+#endif
+#ifdef NES_CPU_PROFILE
+    m_cpu.SetProfiler(&m_cpuProfiler);
+#endif
+    return true;
+}
+
+void Console::SetInput(Byte player1, Byte player2) {
+    m_controller1.SetButtons(player1);
+    m_controller2.SetButtons(player2);
+}
+
+void Console::RunFrame(Byte input) {
+    m_controller1.SetButtons(input);
+    m_frameLimit = m_ppu.GetFrameIndex() + 1;
+    while (m_ppu.GetFrameIndex() < m_frameLimit)
+        RunCycles(29781); //Around one frame
+    m_frameLimit = ~std::uint64_t(0);
+}
+
+void Console::SetFrameSkip(int n) {
+    m_frameSkip = n;
+    m_ppu.SetFrameSkip(n);
+}
+
+/*
+ * 为什么是 3:1？PPU 的时钟是 CPU 的三倍
+ * CPU 在两条指令之间不会访问总线，所以先把 PPU 推进到 CPU 下一条指令执行的那个周期，
+ * 再让 CPU 一次跑完这段，和逐周期交替 Step 的结果完全一致（PPU 触发的 NMI 只会推迟下一条指令）
+*/
+void Console::RunCycles(std::uint64_t cycles) {
+    auto target = m_cpu.GetCycles() + cycles;
+    while (m_cpu.GetCycles() < target && m_ppu.GetFrameIndex() < m_frameLimit) {
+        if (m_cpu.IsIdle()) {
+            RunIdle(target);
+            continue;
+        }
+        auto slice = std::min<std::uint64_t>(m_cpu.GetPendingCycles(), target - m_cpu.GetCycles());
+        for (auto dots = slice * 3; dots > 0; --dots)
+            m_ppu.Step();
+        m_cpu.RunUntil(m_cpu.GetCycles() + slice);
+    }
+}
+
+/*
+ * CPU 在空转循环中既不读 PPU 寄存器也不写内存，只有 NMI 能让它跳出来：
+ * PPU 连续跑到 NMI（或 target）为止，CPU 暂时不动，之后一次性补齐。
+ * 空转循环的结果与时间无关，补跑和逐周期交替执行的结果完全一样
+*/
+void Console::RunIdle(std::uint64_t target) {
+    m_cpuDeferred = true;
+    for (m_deferredCycle = m_cpu.GetCycles();
+         m_deferredCycle < target && m_cpu.IsIdle() && m_ppu.GetFrameIndex() < m_frameLimit; ++m_deferredCycle) {
+        m_ppu.Step();
+        m_ppu.Step();
+        m_ppu.Step();
+    }
+    m_cpuDeferred = false;
+    m_cpu.RunUntil(m_deferredCycle);
+}
+
+void Console::DMA(Byte page) {
+    m_cpu.SkipDMACycles();
+    auto page_ptr = m_bus.GetPagePtr(page);
+    m_ppu.DoDMA(page_ptr);
+}
+
+void Console::Strobe(Byte b) {
+    m_controller1.Strobe(b);
+    m_controller2.Strobe(b);
+}
@@ -0,0 +1,25 @@
+#include <Controller.h>
+
+Controller::Controller() :
+        m_strobe(false),
+        m_buttons(0),
+        m_keyStates(0) {}
+
+void Controller::Strobe(Byte b) {
+    m_strobe = b & 1;
+    if (!m_strobe)
+        m_keyStates = m_buttons;
+}
+
+Byte Controller::Read() {
+    Byte ret;
+    if (m_strobe) {
+        ret = m_buttons & 1;
+    } else {
+        ret = m_keyStates & 1;
+        // 移出的位补 1
+        m_keyStates = 0x80 | (m_keyStates >> 1);
+    }
+    // 高位是开路总线，通常读到 $40
+    return ret | 0x40;
+}
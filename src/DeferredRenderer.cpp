@@ -0,0 +1,147 @@
+#include <DeferredRenderer.h>
+#include <cstring>
+
+DeferredRenderer::DeferredRenderer(Mapper *mapper, int frameSkip) :
+        m_ppu(m_bus),
+        m_busy(false),
+        m_stop(false),
+        m_latestPixels(FramePixels),
+        m_latestFrame(0) {
+    m_bus.SetMapper(mapper);
+    // 这里的 PPU 不连接 CPU，NMI 由模拟线程的 PPU 产生
+    m_ppu.SetInterruptCallback([]() {});
+    m_ppu.SetFrameSkip(frameSkip);
+    m_ppu.Reset();
+    m_thread = std::thread(&DeferredRenderer::Worker, this);
+}
+
+DeferredRenderer::~DeferredRenderer() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_submitted.notify_one();
+    m_thread.join();
+}
+
+void DeferredRenderer::Record(Type type, Byte value, std::uint64_t dot) {
+    m_recording.accesses.push_back({dot, static_cast<Byte>(type), value});
+}
+
+void DeferredRenderer::RecordDMA(const Byte *page, std::uint64_t dot) {
+    // 源页面之后还会被 CPU 改写，必须现在复制
+    m_recording.accesses.push_back({dot, static_cast<Byte>(DMA), 0});
+    m_recording.dmaPages.insert(m_recording.dmaPages.end(), page, page + 256);
+}
+
+void DeferredRenderer::EndFrame(std::uint64_t dot) {
+    m_recording.endDot = dot;
+    FrameLog next;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_completed.wait(lock, [&]() { return m_pending.size() < MaxPendingFrames; });
+        m_pending.push_back(std::move(m_recording));
+        if (!m_recycled.empty()) {
+            next = std::move(m_recycled.back());
+            m_recycled.pop_back();
+        }
+    }
+    m_submitted.notify_one();
+
+    m_recording = std::move(next);
+    m_recording.accesses.clear();
+    m_recording.dmaPages.clear();
+}
+
+bool DeferredRenderer::GetLatestFrame(std::uint64_t &frame, std::vector<std::uint32_t> &pixels,
+                                      std::vector<FrameRect> &dirtyRects) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_latestFrame == frame)
+        return false;
+    frame = m_latestFrame;
+    pixels = m_latestPixels;
+    dirtyRects = m_latestRects;
+    return true;
+}
+
+void DeferredRenderer::Flush() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_completed.wait(lock, [&]() { return m_pending.empty() && !m_busy; });
+}
+
+void DeferredRenderer::Worker() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_submitted.wait(lock, [&]() { return m_stop || !m_pending.empty(); });
+        if (m_stop)
+            return;
+        FrameLog log = std::move(m_pending.front());
+        m_pending.pop_front();
+        m_busy = true;
+        lock.unlock();
+
+        Replay(log);
+        auto frame = m_ppu.GetFrameCount();
+        bool rendered = frame != m_latestFrame;
+        // 转换放在锁外，模拟线程取帧时只需要等一次复制
+        auto pixels = rendered ? m_ppu.GetFrameRGBA() : nullptr;
+
+        lock.lock();
+        if (rendered) {
+            std::memcpy(m_latestPixels.data(), pixels, FramePixels * sizeof(std::uint32_t));
+            m_latestRects = m_ppu.GetDirtyRects();
+            m_latestFrame = frame;
+        }
+        m_recycled.push_back(std::move(log));
+        m_busy = false;
+        m_completed.notify_all();
+    }
+}
+
+void DeferredRenderer::Replay(const FrameLog &log) {
+    auto page = log.dmaPages.data();
+    for (auto &access: log.accesses) {
+        RunTo(access.dot);
+        switch (access.type) {
+            case Control:
+                m_ppu.Control(access.value);
+                break;
+            case Mask:
+                m_ppu.SetMask(access.value);
+                break;
+            case OAMAddress:
+                m_ppu.SetOAMAddress(access.value);
+                break;
+            case OAMData:
+                m_ppu.SetOAMData(access.value);
+                break;
+            case Scroll:
+                m_ppu.SetScroll(access.value);
+                break;
+            case DataAddress:
+                m_ppu.SetDataAddress(access.value);
+                break;
+            case Data:
+                m_ppu.SetData(access.value);
+                break;
+            case ReadStatus:
+                m_ppu.GetStatus();
+                break;
+            case ReadData:
+                m_ppu.GetData();
+                break;
+            case DMA:
+                m_ppu.DoDMA(page);
+                page += 256;
+                break;
+            default:
+                break;
+        }
+    }
+    RunTo(log.endDot);
+}
+
+void DeferredRenderer::RunTo(std::uint64_t dot) {
+    while (m_ppu.GetDotCount() < dot)
+        m_ppu.Step();
+}
@@ -1,130 +1,269 @@
 #include <Emulator.h>
 #include <Log.h>
+#include <cstdio>
+#include <cstring>
 
+/* 构造时还没有人设置过 logger，先按 Error 级别输出到 std::cerr，之后可以通过 GetLog 修改 */
+static std::unique_ptr<Log::Scope> BindLog(Log &log) {
+    log.setLogStream(std::cerr);
+    log.setLevel(Error);
+    return std::unique_ptr<Log::Scope>(new Log::Scope(log));
+}
 
-/*
- * 将 m_cpuCycleDuration增大可方便调试
-*/
 Emulator::Emulator() :
-        m_cpu(m_bus),
+        m_constructionLogScope(BindLog(m_log)),
         m_screenScale(2.f),
-        m_ppu(m_pictureBus, m_emulatorScreen),
-        m_cycleTimer(),
-        m_cpuCycleDuration(std::chrono::nanoseconds(559)) {
-    // 855555559
-    if (!m_bus.SetReadCallback(PPUSTATUS, [&](void) { return m_ppu.GetStatus(); }) ||
-        !m_bus.SetReadCallback(PPUDATA, [&](void) { return m_ppu.GetData(); }) ||
-        // !m_bus.SetReadCallback(JOY1, [&](void) {return m_controller1.Read();}) ||
-        // !m_bus.SetReadCallback(JOY2, [&](void) {return m_controller2.Read();}) ||
-        !m_bus.SetReadCallback(OAMDATA, [&](void) { return m_ppu.GetOAMData(); })) {
-        LOG(Error) << "Critical error: Failed to set I/O callbacks" << std::endl;
-    }
-
-    if (!m_bus.SetWriteCallback(PPUCTRL, [&](Byte b) { m_ppu.Control(b); }) ||
-        !m_bus.SetWriteCallback(PPUMASK, [&](Byte b) { m_ppu.SetMask(b); }) ||
-        !m_bus.SetWriteCallback(OAMADDR, [&](Byte b) { m_ppu.SetOAMAddress(b); }) ||
-        !m_bus.SetWriteCallback(PPUADDR, [&](Byte b) { m_ppu.SetDataAddress(b); }) ||
-        !m_bus.SetWriteCallback(PPUSCROL, [&](Byte b) { m_ppu.SetScroll(b); }) ||
-        !m_bus.SetWriteCallback(PPUDATA, [&](Byte b) { m_ppu.SetData(b); }) ||
-        !m_bus.SetWriteCallback(OAMDMA, [&](Byte b) { DMA(b); }) ||
-        // !m_bus.SetWriteCallback(JOY1, [&](Byte b) {m_controller1.strobe(b); m_controller2.strobe(b);}) ||
-        !m_bus.SetWriteCallback(OAMDATA, [&](Byte b) { m_ppu.SetOAMData(b); })) {
-        LOG(Error) << "Critical error: Failed to set I/O callbacks" << std::endl;
-    }
-    // ppu 设置中断回调函数
-    m_ppu.SetInterruptCallback([&]() { m_cpu.Interrupt(CPU::NMI); });
+        m_publishedFrame(0),
+        m_running(false),
+        m_input(0),
+        m_paused(false),
+        m_stepRequests(0),
+#ifdef NES_CPU_PROFILE
+        m_dumpProfile(false),
+#endif
+        m_presentedFrame(0),
+        m_fastForward(false),
+        m_fastForwardSkip(1),
+        m_frameSkip(1) {
+    m_constructionLogScope.reset();
+}
 
+Emulator::~Emulator() {
+    StopEmulation();
 }
 
+/*
+ * 窗口线程：处理事件、读键盘、设置标题，再取最新的一帧上传、画出并 display()。
+ * SFML 的窗口不是线程安全的，所有窗口调用都在这里；模拟在 EmulationLoop 里另一个线程上运行。
+ * 开着垂直同步时 display() 按刷新率等待，没有新帧也重画上一帧；
+ * 关着时（快进）没有新帧就稍等一下，不空转
+*/
 void Emulator::Run(std::string rom_path) {
-    if (!m_cartridge.LoadFromFile(rom_path)) {
-        LOG(Error) << "Unable to load ROM from file:" << rom_path << std::endl;
-        return;
-    }
-
-    m_mapper = Mapper::CreateMapper(static_cast<Mapper::Type>(m_cartridge.GetMapper()),
-                                    m_cartridge);
+    Log::Scope logScope(m_log);
 
-    if (!m_mapper) {
-        LOG(Error) << "Creating Mapper failed. Probably unsupported." << std::endl;
-        return;
-    }
-    /* 待添加PPU总线的mapper设置 */
-    if (!m_bus.SetMapper(m_mapper.get()) ||
-        !m_pictureBus.SetMapper(m_mapper.get())) {
+    if (!m_console.LoadROM(rom_path))
         return;
-    }
-
-    m_cpu.Reset();
-    m_ppu.Reset();
 
     m_window.create(sf::VideoMode(NESVideoWidth * m_screenScale, NESVideoHeight * m_screenScale),
                     "MyNES", sf::Style::Titlebar | sf::Style::Close);
-    m_window.setVerticalSyncEnabled(true);
     // sf::CircleShape shape(NESVideoWidth);
     // 颜色填充
     // shape.setFillColor(sf::Color::Red);
     m_emulatorScreen.Create(NESVideoWidth, NESVideoHeight, m_screenScale, sf::Color::White);
 
-    m_cycleTimer = std::chrono::high_resolution_clock::now();
-    m_elapsedTime = m_cycleTimer - m_cycleTimer;
+    // 快进时不等垂直同步
+    bool vsync = !m_fastForward;
+    m_window.setVerticalSyncEnabled(vsync);
+
+    m_running = true;
+    m_emulationThread = std::thread(&Emulator::EmulationLoop, this);
+
     sf::Event event{};
     bool isFocus = true, isPause = false;
 
     while (m_window.isOpen()) {
         while (m_window.pollEvent(event)) {
             if (event.type == sf::Event::Closed) {
+                StopEmulation();
                 m_window.close();
+#ifdef NES_CPU_TRACE
+                // 用 NES_trace_decoder 转成文本
+                if (!m_console.GetTrace().Dump("cpu_trace.bin"))
+                    LOG(Error) << "Failed to write CPU trace to cpu_trace.bin" << std::endl;
+#endif
+#ifdef NES_CPU_PROFILE
+                DumpProfile();
+#endif
                 return;
-            } else if (event.type == sf::Event::GainedFocus) {
+            } else if (event.type == sf::Event::GainedFocus)
                 isFocus = true;
-                m_cycleTimer = std::chrono::high_resolution_clock::now();
-            } else if (event.type == sf::Event::LostFocus)
+            else if (event.type == sf::Event::LostFocus)
                 isFocus = false;
-            else if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F2) {
+            else if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F2)
                 isPause = !isPause;
-                if (!isPause)
-                    m_cycleTimer = std::chrono::high_resolution_clock::now();
-            } else if (isPause && event.type == sf::Event::KeyReleased && event.key.code == sf::Keyboard::F3) {
-                for (int i = 0; i < 29781; ++i) //Around one frame
-                {
-                    //PPU
-                    m_ppu.Step();
-                    m_ppu.Step();
-                    m_ppu.Step();
-                    //CPU
-                    m_cpu.Step();
-                }
+            else if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Tab)
+                m_fastForward = !m_fastForward;
+#ifdef NES_CPU_PROFILE
+            else if (event.type == sf::Event::KeyReleased && event.key.code == sf::Keyboard::F5) {
+                m_dumpProfile = true;
+            }
+#endif
+            else if (isPause && event.type == sf::Event::KeyReleased && event.key.code == sf::Keyboard::F3) {
+                ++m_stepRequests;
+            }
+
+        }
+
+        // 交给模拟线程的状态
+        m_paused = isPause || !isFocus;
+        m_input = ReadKeyboard();
+        {
+            std::lock_guard<std::mutex> lock(m_titleMutex);
+            if (!m_title.empty()) {
+                m_window.setTitle(m_title);
+                m_title.clear();
+            }
+        }
+        if (vsync == m_fastForward) {
+            vsync = !vsync;
+            m_window.setVerticalSyncEnabled(vsync);
+        }
+
+        if (m_frames.Acquire()) {
+            auto &frame = m_frames.GetFrontFrame();
+            PresentFrame(frame.number, frame.pixels.data(), frame.dirtyRects);
+        } else if (!vsync) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        m_window.draw(m_emulatorScreen);
+        m_window.display();
+    }
+    StopEmulation();
+}
+
+/*
+ * 模拟线程：每次循环跑一帧（快进时一批）、交给窗口线程、再睡到下一帧的截止时间。
+ * 按键、暂停、单步和快进由窗口线程通过原子变量送过来，算好的标题再送回去
+*/
+void Emulator::EmulationLoop() {
+    Log::Scope logScope(m_log);
+
+    bool fastForward = m_fastForward;
+    ApplyFastForward(fastForward);
+    m_scheduler.Reset();
+    bool paused = false;
+
+    while (m_running) {
+        if (fastForward != m_fastForward) {
+            fastForward = !fastForward;
+            ApplyFastForward(fastForward);
+        }
+#ifdef NES_CPU_PROFILE
+        if (m_dumpProfile.exchange(false))
+            DumpProfile();
+#endif
+
+        if (m_paused) {
+            paused = true;
+            if (m_stepRequests > 0) {
+                --m_stepRequests;
+                m_console.RunFrame(m_input);
+                PublishFrame();
+                // 单步打乱了跳帧分组，让下一批重新从组的开头算起
+                ApplyFastForward(fastForward);
+            } else {
+                // 1/60 second
+                std::this_thread::sleep_for(std::chrono::milliseconds(1000 / 60));
             }
+            continue;
+        }
+        if (paused) {
+            // 暂停或失去焦点之后从现在重新计时，没用掉的单步请求作废
+            paused = false;
+            m_stepRequests = 0;
+            m_scheduler.Reset();
+        }
 
+        // 快进时一次跑 FastForwardSkip() 帧，只显示最后一帧
+        auto frames = fastForward ? FastForwardSkip() : 1;
+        Byte input = m_input;
+        for (int i = 0; i < frames; ++i)
+            m_console.RunFrame(input);
+        PublishFrame();
+        m_scheduler.WaitForNextFrame(frames);
+
+        FrameScheduler::Stats stats{};
+        if (m_scheduler.PollStats(stats)) {
+            char title[96];
+            if (fastForward) {
+                std::snprintf(title, sizeof(title), "MyNES - fast forward %.2fx, %.0f fps",
+                              stats.emulatedFps / 60.0988, stats.emulatedFps);
+            } else
+                std::snprintf(title, sizeof(title), "MyNES - %.1f fps, frame time %.2f +/- %.2f ms",
+                              stats.fps, stats.meanFrameTime, stats.frameTimeStdDev);
+            std::lock_guard<std::mutex> lock(m_titleMutex);
+            m_title = title;
         }
+    }
+}
 
-        if (isFocus && !isPause) {
-            m_elapsedTime += std::chrono::high_resolution_clock::now() - m_cycleTimer;
-            m_cycleTimer = std::chrono::high_resolution_clock::now();
-            // 上次执行的时间大于一个CPU周期
-            while (m_elapsedTime > m_cpuCycleDuration) {
-                // 为什么是 3:1？
-                m_ppu.Step();
-                m_ppu.Step();
-                m_ppu.Step();
+void Emulator::StopEmulation() {
+    m_running = false;
+    if (m_emulationThread.joinable())
+        m_emulationThread.join();
+}
 
-                m_cpu.Step();
+/*
+ * 快进时不限速，并让 PPU 只画要显示的那一帧；垂直同步由窗口线程按 m_fastForward 开关。
+ * 在工作线程上渲染时那边的跳帧设置不变，只是不限速
+*/
+void Emulator::ApplyFastForward(bool fastForward) {
+    m_scheduler.SetUncapped(fastForward);
+    m_console.SetFrameSkip(fastForward ? FastForwardSkip() : m_frameSkip);
+}
 
-                m_elapsedTime -= m_cpuCycleDuration;
+void Emulator::PublishFrame() {
+    auto &back = m_frames.GetBackFrame();
+    if (auto renderer = m_console.GetRenderer()) {
+        if (!renderer->GetLatestFrame(m_publishedFrame, back.pixels, back.dirtyRects))
+            return;
+    } else {
+        if (m_console.GetFrameCount() == m_publishedFrame)
+            return;
+        m_publishedFrame = m_console.GetFrameCount();
+        std::memcpy(back.pixels.data(), m_console.GetFrameRGBA(), FramePixels * sizeof(std::uint32_t));
+        back.dirtyRects = m_console.GetDirtyRects();
+    }
+    back.number = m_publishedFrame;
+    m_frames.Publish();
+}
 
+void Emulator::PresentFrame(std::uint64_t frame, const std::uint32_t *pixels,
+                            const std::vector<FrameRect> &dirtyRects) {
+    if (frame == m_presentedFrame + 1) {
+        // 按整行上传，同一行上的几个脏矩形合并成连续的行区间，每段只上传一次
+        bool dirty[NESVideoHeight] = {};
+        for (auto &rect: dirtyRects)
+            std::fill(dirty + rect.y, dirty + rect.y + rect.height, true);
+        for (int y = 0; y < NESVideoHeight;) {
+            if (!dirty[y]) {
+                ++y;
+                continue;
             }
-            m_window.draw(m_emulatorScreen);
-            m_window.display();
-        } else {
-            // 1/60 second
-            sf::sleep(sf::milliseconds(1000 / 60));
+            int end = y;
+            while (end < NESVideoHeight && dirty[end])
+                ++end;
+            m_emulatorScreen.SetRows(pixels, y, end - y);
+            y = end;
         }
+    } else
+        m_emulatorScreen.SetFrame(pixels);
+    m_presentedFrame = frame;
+}
+
+/*
+ * 键位：方向 W/A/S/D，A 键 J，B 键 K，Select 右 Shift，Start 回车
+*/
+Byte Emulator::ReadKeyboard() {
+    static const sf::Keyboard::Key keys[Controller::TotalButtons] = {
+            sf::Keyboard::J, sf::Keyboard::K, sf::Keyboard::RShift, sf::Keyboard::Return,
+            sf::Keyboard::W, sf::Keyboard::S, sf::Keyboard::A, sf::Keyboard::D,
+    };
+    Byte buttons = 0;
+    if (m_window.hasFocus()) {
+        for (int i = 0; i < Controller::TotalButtons; ++i)
+            buttons |= sf::Keyboard::isKeyPressed(keys[i]) << i;
     }
+    return buttons;
 }
 
-void Emulator::DMA(Byte page) {
-    m_cpu.SkipDMACycles();
-    auto page_ptr = m_bus.GetPagePtr(page);
-    m_ppu.DoDMA(page_ptr);
+#ifdef NES_CPU_PROFILE
+void Emulator::DumpProfile() {
+    auto &profiler = m_console.GetProfiler();
+    if (profiler.DumpJSON("cpu_profile.json") && profiler.DumpCSV("cpu_profile.csv"))
+        LOG(Info) << "CPU profile written to cpu_profile.json and cpu_profile.csv" << std::endl;
+    else
+        LOG(Error) << "Failed to write CPU profile" << std::endl;
 }
+#endif
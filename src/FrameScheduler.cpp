@@ -0,0 +1,107 @@
+#include <FrameScheduler.h>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace {
+    // 落后超过这么多帧就不再追赶
+    const int MaxBehindFrames = 4;
+
+    const std::chrono::microseconds MinWakeupLatency(200);
+    const std::chrono::microseconds MaxWakeupLatency(4000);
+}
+
+FrameScheduler::FrameScheduler(double fps) :
+        m_period(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps))),
+        m_wakeupLatency(std::chrono::microseconds(1000)),
+        m_uncapped(false),
+        m_stats() {
+    Reset();
+}
+
+void FrameScheduler::Reset() {
+    auto now = Clock::now();
+    m_deadline = now + m_period;
+    m_lastFrame = now;
+    m_statsStart = now;
+    m_frames = m_lateFrames = 0;
+    m_emulatedFrames = 0;
+    m_sum = m_sumSquares = 0;
+    m_statsReady = false;
+}
+
+void FrameScheduler::WaitForNextFrame(int emulatedFrames) {
+    auto now = Clock::now();
+    if (!m_uncapped) {
+        if (now < m_deadline)
+            SleepUntil(m_deadline);
+        else if (now - m_deadline > m_period / 2)
+            ++m_lateFrames;
+
+        now = Clock::now();
+        // 下一帧的截止时间从这一帧的截止时间算起，而不是从醒来的时间，误差不会累积
+        m_deadline += m_period;
+        if (now - m_deadline > m_period * MaxBehindFrames)
+            m_deadline = now + m_period;
+    }
+
+    double frameTime = std::chrono::duration<double, std::milli>(now - m_lastFrame).count();
+    m_lastFrame = now;
+    ++m_frames;
+    m_emulatedFrames += emulatedFrames;
+    m_sum += frameTime;
+    m_sumSquares += frameTime * frameTime;
+
+    if (now - m_statsStart >= std::chrono::seconds(1)) {
+        double mean = m_sum / m_frames;
+        double seconds = std::chrono::duration<double>(now - m_statsStart).count();
+        m_stats.fps = m_frames / seconds;
+        m_stats.emulatedFps = m_emulatedFrames / seconds;
+        m_stats.meanFrameTime = mean;
+        m_stats.frameTimeStdDev = std::sqrt(std::max(0.0, m_sumSquares / m_frames - mean * mean));
+        m_stats.lateFrames = m_lateFrames;
+        m_statsReady = true;
+        m_statsStart = now;
+        m_frames = m_lateFrames = 0;
+        m_emulatedFrames = 0;
+        m_sum = m_sumSquares = 0;
+    }
+}
+
+void FrameScheduler::SetUncapped(bool uncapped) {
+    if (m_uncapped == uncapped)
+        return;
+    m_uncapped = uncapped;
+    Reset();
+}
+
+bool FrameScheduler::PollStats(Stats &stats) {
+    if (!m_statsReady)
+        return false;
+    stats = m_stats;
+    m_statsReady = false;
+    return true;
+}
+
+/*
+ * 操作系统的睡眠会晚醒，先睡到截止时间前一点，剩下的用 yield 自旋。
+ * 提前量按实际观察到的晚醒时间调整，睡眠准的系统上自旋的时间就很短
+*/
+void FrameScheduler::SleepUntil(Clock::time_point deadline) {
+    auto wakeup = deadline - m_wakeupLatency;
+    auto start = Clock::now();
+    if (wakeup > start) {
+        std::this_thread::sleep_until(wakeup);
+        auto late = Clock::now() - wakeup;
+        // 偏大估计，晚醒超过提前量时直接跟上，否则缓慢回落
+        auto target = late * 3 / 2;
+        if (target > m_wakeupLatency)
+            m_wakeupLatency = target;
+        else
+            m_wakeupLatency -= (m_wakeupLatency - target) / 16;
+        m_wakeupLatency = std::min<Clock::duration>(std::max<Clock::duration>(m_wakeupLatency, MinWakeupLatency),
+                                                    MaxWakeupLatency);
+    }
+    while (Clock::now() < deadline)
+        std::this_thread::yield();
+}
@@ -0,0 +1,23 @@
+#include <FrameTripleBuffer.h>
+
+FrameTripleBuffer::FrameTripleBuffer() :
+        m_middle(1),
+        m_back(0),
+        m_front(2) {
+    for (auto &frame: m_frames) {
+        frame.number = 0;
+        frame.pixels.resize(FramePixels);
+    }
+}
+
+void FrameTripleBuffer::Publish() {
+    // release 让消费者看到这一帧写入的像素，acquire 保证拿回来的那块消费者已经不再读
+    m_back = m_middle.exchange(m_back | FreshBit, std::memory_order_acq_rel) & IndexMask;
+}
+
+bool FrameTripleBuffer::Acquire() {
+    if (!(m_middle.load(std::memory_order_relaxed) & FreshBit))
+        return false;
+    m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & IndexMask;
+    return true;
+}
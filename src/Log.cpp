@@ -2,20 +2,37 @@
 
 #include <Log.h>
 
+namespace
+{
+    thread_local Log* currentLog = nullptr;
+}
+
+Log::Log() :
+    m_logLevel(None),
+    m_logStream(nullptr)
+{
+}
+
 Log::~Log()
 {
 }
 
-Log& Log::get()
+Log* Log::current()
 {
-    static Log instance;
-    return instance;
+    return currentLog;
 }
 
-std::ostream& Log::getCpuTraceStream()
+Log::Scope::Scope(Log& log) :
+    m_previous(currentLog)
 {
-    return *m_cpuTrace;
+    currentLog = &log;
 }
+
+Log::Scope::~Scope()
+{
+    currentLog = m_previous;
+}
+
 std::ostream& Log::getStream()
 {
     return *m_logStream;
@@ -26,11 +43,6 @@ void Log::setLogStream(std::ostream& stream)
     m_logStream = &stream;
 }
 
-void Log::setCpuTraceStream(std::ostream& stream)
-{
-    m_cpuTrace = &stream;
-}
-
 Log& Log::setLevel(Level level)
 {
     m_logLevel = level;
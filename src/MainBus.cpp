@@ -1,9 +1,20 @@
 #include <MainBus.h>
+#include <PPU.h>
 #include <iostream>
 #include <Log.h>
+#include <algorithm>
+#include <iterator>
 
 /*  0x800 = 2KB */
-MainBus::MainBus() : m_RAM(0x800, 0) {
+MainBus::MainBus() : m_RAM(0x800, 0), m_mapper(nullptr), m_ppu(nullptr) {
+    std::fill(std::begin(m_readPages), std::end(m_readPages), nullptr);
+    std::fill(std::begin(m_writePages), std::end(m_writePages), nullptr);
+    std::fill(std::begin(m_readHandlers), std::end(m_readHandlers), ReadHandler{nullptr, nullptr});
+    std::fill(std::begin(m_writeHandlers), std::end(m_writeHandlers), WriteHandler{nullptr, nullptr});
+    // $0000-$1FFF 为 2KB RAM 镜像 4 次
+    for (int page = 0; page < 0x20; ++page) {
+        m_readPages[page] = m_writePages[page] = &m_RAM[(page & 0x7) << 8];
+    }
 }
 
 
@@ -15,12 +26,33 @@ bool MainBus::SetMapper(Mapper *mapper) {
         return false;
     }
 
-    if (mapper->HasExtendedRAM())
+    if (mapper->HasExtendedRAM()) {
         m_extRAM.resize(0x2000);
+        for (int page = 0x60; page < 0x80; ++page) {
+            m_readPages[page] = m_writePages[page] = &m_extRAM[(page - 0x60) << 8];
+        }
+    }
+
+    UpdatePRGPages();
+    return true;
+}
 
+bool MainBus::SetPPU(PPU *ppu) {
+    if (!ppu) {
+        LOG(Error) << "PPU pointer is nullptr" << std::endl;
+        return false;
+    }
+    m_ppu = ppu;
     return true;
 }
 
+/* PRG 区只读，写操作都要交给 mapper（bank 切换等寄存器写入） */
+void MainBus::UpdatePRGPages() {
+    for (int page = 0x80; page < 0x100; ++page) {
+        m_readPages[page] = m_mapper->GetPRGPagePtr(page << 8);
+    }
+}
+
 /*
  * CPU Memory Map
 --------------------------------------- $10000
@@ -39,34 +71,60 @@ bool MainBus::SetMapper(Mapper *mapper) {
 */
 
 
+/*
+ * 普通内存直接通过页表读写，页表项为 nullptr 的页（I/O 寄存器、mapper 寄存器等）
+ * 才走下面按地址范围判断的慢速路径
+*/
 Byte MainBus::Read(Address addr) {
-    /* 0x2000 =  8KB RAM  */
+    auto page = m_readPages[addr >> 8];
+    if (page)
+        return page[addr & 0xff];
+    return ReadSlow(addr);
+}
 
+Byte MainBus::Peek(Address addr) {
+    auto page = m_readPages[addr >> 8];
+    return page ? page[addr & 0xff] : 0;
+}
+
+void MainBus::Write(Address addr, Byte value) {
+    auto page = m_writePages[addr >> 8];
+    if (page)
+        page[addr & 0xff] = value;
+    else
+        WriteSlow(addr, value);
+}
+
+Byte MainBus::ReadSlow(Address addr) {
+    // PPU 寄存器 映射到了主总线上，是走到这里最多的访问，先判断
+    // 位于 $2000-$2007，位置$2000-$2007在$2008-$3FFF区域中每8个字节镜像一次
+    if (addr >= 0x2000 && addr < 0x4000 && m_ppu) {
+        switch (addr & 0x7) {
+            case PPUSTATUS & 0x7:
+                return m_ppu->GetStatus();
+            case OAMDATA & 0x7:
+                return m_ppu->GetOAMData();
+            case PPUDATA & 0x7:
+                return m_ppu->GetData();
+            default:
+                break;
+        }
+    }
+
+    /* 0x2000 =  8KB RAM  */
     if (addr < 0x2000) {
         /* 实际只有2KB RAM(如上定义的0x800)，所以采用addr & 0x7ff的操作 */
         return m_RAM[addr & 0x7ff];
+    } else if (addr < 0x4000) {
+        LOG(InfoVerbose) << "Unsupported PPU register read at: " << std::hex << +addr << std::endl;
     } else if (addr < 0x4020) {
-        // PPU 寄存器 映射到了主总线上
-        // 位于 $2000-$2007，另一个寄存器用于直接内存访问，地址为$4014
-        // 位置$2000-$2007在$2008-$3FFF区域中每8个字节镜像一次
-        if (addr < 0x4000) {
-            // IO 寄存器的读写使用Map来实现，妙啊
-            auto it = m_readCallbacks.find(static_cast<IORegisters>(addr & 0x2007));
-            if (it != m_readCallbacks.end()) {
-                // it->second 保存了 Read函数指针
-                return (it->second)();
-            } else {
-                LOG(InfoVerbose) << "No read callback registered for I/O register at: " << std::hex << +addr
-                                 << std::endl;
-            }
-        } else if (addr < 0x4018 && addr >= 0x4014) {
-            auto it = m_readCallbacks.find(static_cast<IORegisters>(addr));
-            if (it != m_readCallbacks.end())
-                return (it->second)();
-            else LOG(InfoVerbose) << "No read callback registered for I/O register at: " << std::hex << +addr
-                                  << std::endl;
+        // 另一个寄存器用于直接内存访问，地址为$4014；IO 寄存器按偏移直接查表
+        auto &handler = m_readHandlers[addr & 0x1f];
+        if (handler.call) {
+            return handler.call(handler.object);
         } else {
-            LOG(InfoVerbose) << "Read access attempt at: " << std::hex << +addr << std::endl;
+            LOG(InfoVerbose) << "No read callback registered for I/O register at: " << std::hex << +addr
+                             << std::endl;
         }
     } else if (addr < 0x6000) {
         LOG(InfoVerbose) << "Expansion ROM read attempted. This is currently unsupported" << std::endl;
@@ -83,29 +141,46 @@ Byte MainBus::Read(Address addr) {
     return 0;
 }
 
-void MainBus::Write(Address addr, Byte value) {
+void MainBus::WriteSlow(Address addr, Byte value) {
+    //PPU registers are mirrored every 8 bytes
+    if (addr >= 0x2000 && addr < 0x4000 && m_ppu) {
+        switch (addr & 0x7) {
+            case PPUCTRL & 0x7:
+                m_ppu->Control(value);
+                return;
+            case PPUMASK & 0x7:
+                m_ppu->SetMask(value);
+                return;
+            case OAMADDR & 0x7:
+                m_ppu->SetOAMAddress(value);
+                return;
+            case OAMDATA & 0x7:
+                m_ppu->SetOAMData(value);
+                return;
+            case PPUSCROL & 0x7:
+                m_ppu->SetScroll(value);
+                return;
+            case PPUADDR & 0x7:
+                m_ppu->SetDataAddress(value);
+                return;
+            case PPUDATA & 0x7:
+                m_ppu->SetData(value);
+                return;
+            default:
+                break;
+        }
+    }
+
     if (addr < 0x2000) {
         m_RAM[addr & 0x7ff] = value;
+    } else if (addr < 0x4000) {
+        LOG(InfoVerbose) << "Unsupported PPU register write at: " << std::hex << +addr << std::endl;
     } else if (addr < 0x4020) {
-        if (addr < 0x4000) //PPU registers, mirrored
-        {
-            auto it = m_writeCallbacks.find(static_cast<IORegisters>(addr & 0x2007));
-            if (it != m_writeCallbacks.end())
-                (it->second)(value);
-                //Second object is the pointer to the function object
-                //Dereference the function pointer and call it
-            else LOG(InfoVerbose) << "No write callback registered for I/O register at: " << std::hex << +addr
-                                  << std::endl;
-        } else if (addr < 0x4017 && addr >= 0x4014) //only some registers
-        {
-            auto it = m_writeCallbacks.find(static_cast<IORegisters>(addr));
-            if (it != m_writeCallbacks.end())
-                (it->second)(value);
-                //Second object is the pointer to the function object
-                //Dereference the function pointer and call it
-            else LOG(InfoVerbose) << "No write callback registered for I/O register at: " << std::hex << +addr
-                                  << std::endl;
-        } else LOG(InfoVerbose) << "Write access attmept at: " << std::hex << +addr << std::endl;
+        auto &handler = m_writeHandlers[addr & 0x1f];
+        if (handler.call)
+            handler.call(handler.object, value);
+        else LOG(InfoVerbose) << "No write callback registered for I/O register at: " << std::hex << +addr
+                              << std::endl;
     } else if (addr < 0x6000) {
         LOG(InfoVerbose) << "Expansion ROM access attempted. This is currently unsupported" << std::endl;
     } else if (addr < 0x8000) {
@@ -117,20 +192,36 @@ void MainBus::Write(Address addr, Byte value) {
     }
 }
 
-bool MainBus::SetWriteCallback(IORegisters reg, std::function<void(Byte)> callback) {
-    if (!callback) {
-        LOG(Error) << "callback argument is nullptr" << std::endl;
+bool MainBus::SetWriteHandler(IORegisters reg, void *object, void (*call)(void *, Byte)) {
+    if (!object) {
+        LOG(Error) << "callback object is nullptr" << std::endl;
         return false;
     }
-    return m_writeCallbacks.emplace(reg, callback).second;
+    if (reg < 0x4000) {
+        LOG(Error) << "PPU registers are dispatched through SetPPU" << std::endl;
+        return false;
+    }
+    auto &handler = m_writeHandlers[reg & 0x1f];
+    if (handler.call)
+        return false;
+    handler = WriteHandler{object, call};
+    return true;
 }
 
-bool MainBus::SetReadCallback(IORegisters reg, std::function<Byte(void)> callback) {
-    if (!callback) {
-        LOG(Error) << "callback argument is nullptr" << std::endl;
+bool MainBus::SetReadHandler(IORegisters reg, void *object, Byte (*call)(void *)) {
+    if (!object) {
+        LOG(Error) << "callback object is nullptr" << std::endl;
         return false;
     }
-    return m_readCallbacks.emplace(reg, callback).second;
+    if (reg < 0x4000) {
+        LOG(Error) << "PPU registers are dispatched through SetPPU" << std::endl;
+        return false;
+    }
+    auto &handler = m_readHandlers[reg & 0x1f];
+    if (handler.call)
+        return false;
+    handler = ReadHandler{object, call};
+    return true;
 }
 
 
@@ -139,6 +230,9 @@ bool MainBus::SetReadCallback(IORegisters reg, std::function<Byte(void)> callbac
  * 每个页大小为256B
 */
 const Byte *MainBus::GetPagePtr(Byte page) {
+    if (m_readPages[page])
+        return m_readPages[page];
+
     Address addr = page << 8;
     if (addr < 0x2000)
         return &m_RAM[addr & 0x7ff];
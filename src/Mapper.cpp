@@ -9,6 +9,25 @@ NameTableMirroring Mapper::GetNameTableMirroring() {
     return static_cast<NameTableMirroring>(m_cartridge.GetNameTableMirroring());
 }
 
+void Mapper::UpdatePatternRow(Address addr) {
+    addr &= 0x1ff7;
+    Byte low = ReadCHR(addr), high = ReadCHR(addr + 8);
+    auto row = &m_patternCache[PatternRowIndex(addr) * 8];
+    auto flipped = &m_patternCache[(PatternRows + PatternRowIndex(addr)) * 8];
+    for (int i = 0; i < 8; ++i) {
+        Byte pixel = ((low >> (7 - i)) & 1) | ((high >> (7 - i)) & 1) << 1;
+        row[i] = pixel;
+        flipped[7 - i] = pixel;
+    }
+}
+
+void Mapper::UpdatePatternCache() {
+    for (Address addr = 0; addr < 0x2000; addr += 16) {
+        for (int y = 0; y < 8; ++y)
+            UpdatePatternRow(addr + y);
+    }
+}
+
 std::unique_ptr<Mapper> Mapper::CreateMapper(Mapper::Type t, Cartridge &cart, std::function<void(void)> mirroring_cb) {
     std::unique_ptr<Mapper> ret(nullptr);
     switch (t) {
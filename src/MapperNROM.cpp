@@ -27,6 +27,7 @@ MapperNROM::MapperNROM(Cartridge &cart) : Mapper(cart, Mapper::NROM) {
         LOG(Info) << "Using CHR-ROM" << std::endl;
         m_usesCharacterRAM = false;
     }
+    UpdatePatternCache();
 }
 
 void MapperNROM::WritePRG(Address addr, Byte value) {
@@ -42,6 +43,14 @@ Byte MapperNROM::ReadPRG(Address addr) {
     }
 }
 
+const Byte *MapperNROM::GetPRGPagePtr(Address addr) {
+    if (!m_oneBank) {
+        return &m_cartridge.GetROM()[(addr - 0x8000) & 0xff00];
+    } else {
+        return &m_cartridge.GetROM()[(addr - 0x8000) & 0x3f00];
+    }
+}
+
 Byte MapperNROM::ReadCHR(Address addr) {
     // 这里不进行越界判断？
     if (m_usesCharacterRAM) {
@@ -54,6 +63,7 @@ Byte MapperNROM::ReadCHR(Address addr) {
 void MapperNROM::WriteCHR(Address addr, Byte value) {
     if (m_usesCharacterRAM) {
         m_characterRAM[addr] = value;
+        UpdatePatternRow(addr);
     } else {
         LOG(Info) << "Read-only CHR memory write attempt at " << std::hex << addr << std::endl;
     }
@@ -1,18 +1,66 @@
 #include<PPU.h>
 #include<Log.h>
 #include<PaletteColors.h>
+#include <algorithm>
+#include <cstring>
 
 /*
  * PPU的实现是NES模拟器最复杂的一部分
 */
 
-PPU::PPU(PictureBus &bus, VirtualScreen &screen) :
+/*
+ * PPUMASK 的 bit 5-7 依次强调红、绿、蓝（NTSC），被强调的通道保持不变，其余两个通道衰减，
+ * 多个强调位同时设置时衰减叠加
+*/
+static std::uint32_t Emphasize(std::uint32_t rgba, int emphasis) {
+    const double attenuation = 0.816328;
+    double red = (rgba >> 24) & 0xff, green = (rgba >> 16) & 0xff, blue = (rgba >> 8) & 0xff;
+    if (emphasis & 0x1) {
+        green *= attenuation;
+        blue *= attenuation;
+    }
+    if (emphasis & 0x2) {
+        red *= attenuation;
+        blue *= attenuation;
+    }
+    if (emphasis & 0x4) {
+        red *= attenuation;
+        green *= attenuation;
+    }
+    return std::uint32_t(red) << 24 | std::uint32_t(green) << 16 | std::uint32_t(blue) << 8 | (rgba & 0xff);
+}
+
+PPU::PPU(PictureBus &bus) :
         m_bus(bus),
-        m_screen(screen),
         m_spriteMemory(64 * 4),
-        m_pictureBuffer(ScanlineVisibleDots, std::vector<sf::Color>(VisibleScanlines, sf::Color::Magenta)) {
-    // VisibleScanlines 红白机 240 
-    // Magenta 品红
+        m_accessLog(nullptr),
+        m_frameCount(0),
+        m_emphasisStorage(2 * VisibleScanlines),
+        m_palettes(8 * 64),
+        m_frameSkip(1),
+        m_renderEnabled(true),
+        m_frameIndex(0),
+        m_frameSkipStart(0),
+        m_previousFrameValid(false),
+        m_rgbaFrame(FramePixels),
+        m_rgbaFrameCount(~std::uint64_t(0)) {
+    // 两帧放在同一块内存里，起始地址对齐到 cache line
+    m_frameStorage.resize(2 * FramePixels + FrameBufferAlignment);
+    auto base = reinterpret_cast<std::uintptr_t>(m_frameStorage.data());
+    base = (base + FrameBufferAlignment - 1) & ~std::uintptr_t(FrameBufferAlignment - 1);
+    m_frontBuffer = reinterpret_cast<Byte *>(base);
+    m_backBuffer = m_frontBuffer + FramePixels;
+    m_frontEmphasis = m_emphasisStorage.data();
+    m_backEmphasis = m_frontEmphasis + VisibleScanlines;
+
+    for (int emphasis = 0; emphasis < 8; ++emphasis) {
+        for (int i = 0; i < 64; ++i) {
+            // 按内存中 R、G、B、A 的字节顺序存放，转换出的整帧可以直接作为纹理数据上传
+            auto color = Emphasize(colors[i], emphasis);
+            Byte bytes[4] = {Byte(color >> 24), Byte(color >> 16), Byte(color >> 8), Byte(color)};
+            std::memcpy(&m_palettes[emphasis * 64 + i], bytes, sizeof(bytes));
+        }
+    }
 }
 
 void PPU::SetInterruptCallback(std::function<void(void)> cb) {
@@ -20,18 +68,29 @@ void PPU::SetInterruptCallback(std::function<void(void)> cb) {
 }
 
 void PPU::Reset() {
-    m_longSprites = m_generateInterrupt = m_greyscaleMode = m_vblank = false;
+    m_longSprites = m_generateInterrupt = m_vblank = false;
+    m_greyscaleMask = 0x3f;
+    m_emphasis = 0;
     m_showBackground = m_showSprites = m_evenFrame = m_firstWrite = true;
     m_bgPage = m_sprPage = Low;
     m_dataAddress = m_cycle = m_scanline = m_spriteDataAddress = m_fineXScroll = m_tempAddress = 0;
     //m_baseNameTable = 0x2000;
     m_dataAddrIncrement = 1;
     m_pipelineState = PreRender;
+    m_lineDeferred = m_spriteLineValid = false;
+    m_tileAddress = -1;
+    m_skipFrame = false;
+    m_frameIndex = m_frameSkipStart = 0;
+    m_dotCount = 0;
+    m_previousFrameValid = false;
     m_scanlineSprites.reserve(8);
     m_scanlineSprites.resize(0);
 }
 
 void PPU::Step() {
+    // 包括正在处理的这个点
+    ++m_dotCount;
+
     switch (m_pipelineState) {
         case PreRender:
             if (m_cycle == 1)
@@ -51,120 +110,27 @@ void PPU::Step() {
             if (m_cycle >= ScanlineEndCycle - (!m_evenFrame && m_showBackground && m_showSprites)) {
                 m_pipelineState = Render;
                 m_cycle = m_scanline = 0;
+                m_lineDeferred = true;
+                // 每 m_frameSkip 帧只画最后一帧
+                m_skipFrame = !m_renderEnabled ||
+                              (m_frameSkip > 1 && (m_frameIndex - m_frameSkipStart + 1) % m_frameSkip != 0);
+                m_spriteLineValid = false;
             }
             break;
         case Render:
-            if (m_cycle > 0 && m_cycle <= ScanlineVisibleDots) {
-                Byte bgColor = 0, sprColor = 0;
-                bool bgOpaque = false, sprOpaque = true;
-                bool spriteForeground = false;
-
-                int x = m_cycle - 1;
-                int y = m_scanline;
-
-                if (m_showBackground) {
-                    auto x_fine = (m_fineXScroll + x) % 8;
-                    if (!m_hideEdgeBackground || x >= 8) {
-                        //fetch tile
-                        auto addr = 0x2000 | (m_dataAddress & 0x0FFF); //mask off fine y
-                        //auto addr = 0x2000 + x / 8 + (y / 8) * (ScanlineVisibleDots / 8);
-                        Byte tile = Read(addr);
-
-                        //fetch pattern
-                        //Each pattern occupies 16 bytes, so multiply by 16
-                        addr = (tile * 16) + ((m_dataAddress >> 12/*y % 8*/) & 0x7); //Add fine y
-                        addr |= m_bgPage << 12; //set whether the pattern is in the high or low page
-                        //Get the corresponding bit determined by (8 - x_fine) from the right
-                        bgColor = (Read(addr) >> (7 ^ x_fine)) & 1; //bit 0 of palette entry
-                        bgColor |= ((Read(addr + 8) >> (7 ^ x_fine)) & 1) << 1; //bit 1
-
-                        bgOpaque = bgColor; //flag used to calculate final pixel with the sprite pixel
-
-                        //fetch attribute and calculate higher two bits of palette
-                        addr = 0x23C0 | (m_dataAddress & 0x0C00) | ((m_dataAddress >> 4) & 0x38)
-                               | ((m_dataAddress >> 2) & 0x07);
-                        auto attribute = Read(addr);
-                        int shift = ((m_dataAddress >> 4) & 4) | (m_dataAddress & 2);
-                        //Extract and set the upper two bits for the color
-                        bgColor |= ((attribute >> shift) & 0x3) << 2;
-                    }
-                    //Increment/wrap coarse X
-                    if (x_fine == 7) {
-                        if ((m_dataAddress & 0x001F) == 31) // if coarse X == 31
-                        {
-                            m_dataAddress &= ~0x001F;          // coarse X = 0
-                            m_dataAddress ^= 0x0400;           // switch horizontal nametable
-                        } else
-                            m_dataAddress += 1;                // increment coarse X
-                    }
+            if (m_cycle == ScanlineVisibleDots + 1) {
+                if (m_lineDeferred) {
+                    RenderScanline();
+                    m_lineDeferred = false;
                 }
+                // 颜色强调按行记录，转换成 RGBA 时才用到
+                m_backEmphasis[m_scanline] = m_emphasis;
+            }
 
-                if (m_showSprites && (!m_hideEdgeSprites || x >= 8)) {
-                    for (auto i: m_scanlineSprites) {
-                        Byte spr_x = m_spriteMemory[i * 4 + 3];
-
-                        if (0 > x - spr_x || x - spr_x >= 8)
-                            continue;
-
-                        Byte spr_y = m_spriteMemory[i * 4 + 0] + 1,
-                                tile = m_spriteMemory[i * 4 + 1],
-                                attribute = m_spriteMemory[i * 4 + 2];
-
-                        int length = (m_longSprites) ? 16 : 8;
-
-                        int x_shift = (x - spr_x) % 8, y_offset = (y - spr_y) % length;
-
-                        if ((attribute & 0x40) == 0) //If NOT flipping horizontally
-                            x_shift ^= 7;
-                        if ((attribute & 0x80) != 0) //IF flipping vertically
-                            y_offset ^= (length - 1);
-
-                        Address addr = 0;
-
-                        if (!m_longSprites) {
-                            addr = tile * 16 + y_offset;
-                            if (m_sprPage == High) addr += 0x1000;
-                        } else //8x16 sprites
-                        {
-                            //bit-3 is one if it is the bottom tile of the sprite, multiply by two to get the next pattern
-                            y_offset = (y_offset & 7) | ((y_offset & 8) << 1);
-                            addr = (tile >> 1) * 32 + y_offset;
-                            addr |= (tile & 1) << 12; //Bank 0x1000 if bit-0 is high
-                        }
-
-                        sprColor |= (Read(addr) >> (x_shift)) & 1; //bit 0 of palette entry
-                        sprColor |= ((Read(addr + 8) >> (x_shift)) & 1) << 1; //bit 1
-
-                        if (!(sprOpaque = sprColor)) {
-                            sprColor = 0;
-                            continue;
-                        }
-
-                        sprColor |= 0x10; //Select sprite palette
-                        sprColor |= (attribute & 0x3) << 2; //bits 2-3
-
-                        spriteForeground = !(attribute & 0x20);
-
-                        //Sprite-0 hit detection
-                        if (!m_sprZeroHit && m_showBackground && i == 0 && sprOpaque && bgOpaque) {
-                            m_sprZeroHit = true;
-                        }
-
-                        break; //Exit the loop now since we've found the highest priority sprite
-                    }
-                }
-
-                Byte paletteAddr = bgColor;
-
-                if ((!bgOpaque && sprOpaque) ||
-                    (bgOpaque && sprOpaque && spriteForeground))
-                    paletteAddr = sprColor;
-                else if (!bgOpaque && !sprOpaque)
-                    paletteAddr = 0;
-                //else bgColor
-
-//                     m_screen.setPixel(x, y, sf::Color(colors[m_bus.ReadPalette(paletteAddr)]));
-                m_pictureBuffer[x][y] = sf::Color(colors[m_bus.ReadPalette(paletteAddr)]);
+            if (m_cycle > 0 && m_cycle <= ScanlineVisibleDots) {
+                // 本行还没有寄存器访问时像素留到第 257 个点整行一起画
+                if (!m_lineDeferred)
+                    RenderDot(m_cycle - 1);
             } else if (m_cycle == ScanlineVisibleDots + 1 && m_showBackground) {
                 //Shamelessly copied from nesdev wiki
                 if ((m_dataAddress & 0x7000) != 0x7000)  // if fine Y < 7
@@ -216,6 +182,8 @@ void PPU::Step() {
 
                 ++m_scanline;
                 m_cycle = 0;
+                m_lineDeferred = true;
+                m_spriteLineValid = false;
             }
 
             if (m_scanline >= VisibleScanlines)
@@ -228,12 +196,16 @@ void PPU::Step() {
                 m_cycle = 0;
                 m_pipelineState = VerticalBlank;
 
-                for (int x = 0; x < m_pictureBuffer.size(); ++x) {
-                    // 直接用[0]的size来索引了
-                    for (int y = 0; y < m_pictureBuffer[0].size(); ++y) {
-                        m_screen.SetPixel(x, y, m_pictureBuffer[x][y]);
-                    }
+                // 画完的一帧成为前缓冲，下一帧画到另一块上；跳过的帧没有新画面
+                if (!m_skipFrame) {
+                    std::swap(m_frontBuffer, m_backBuffer);
+                    std::swap(m_frontEmphasis, m_backEmphasis);
+                    ++m_frameCount;
+                    UpdateDirtyRects();
                 }
+                ++m_frameIndex;
+                if (m_accessLog)
+                    m_accessLog->EndFrame(m_dotCount);
 
                 //Should technically be done at first dot of VBlank, but this is close enough
 //                     m_vblank = true;
@@ -268,8 +240,275 @@ void PPU::Step() {
 }
 
 
+/*
+ * 两种渲染方式：
+ * 一行里 CPU 没有碰过 PPU 寄存器时，像素推迟到第 257 个点由 RenderScanline 整行画出，背景每 8 个点只取一次 tile；
+ * 一旦 CPU 在行中间访问寄存器（例如 SMB 状态栏的分屏滚动），先用 CatchUpScanline 按逐点的方式补画到当前点，
+ * 本行剩下的点回到 RenderDot 逐点渲染。两种方式画出的像素完全相同
+*/
+void PPU::CatchUpScanline() {
+    if (m_pipelineState != Render || !m_lineDeferred)
+        return;
+    // m_cycle 是下一个要处理的点，之前的点都应该已经画好
+    for (int x = 0; x < std::min(m_cycle - 1, ScanlineVisibleDots); ++x)
+        RenderDot(x);
+    m_lineDeferred = false;
+}
+
+/*
+ * 背景 tile 锁存，相当于 2C02 的图案/属性移位寄存器：一个 tile 的 nametable、图案和属性只取一次，
+ * 之后 8 个点按 fine X 的偏移依次移出像素。m_dataAddress 改变（coarse X 递增或寄存器写入）、
+ * 背景图案表切换、VRAM 被写入时锁存失效，重新取下一次
+*/
+void PPU::FetchTile() {
+    //fetch tile
+    Address addr = 0x2000 | (m_dataAddress & 0x0FFF); //mask off fine y
+    Byte tile = Read(addr);
+
+    //fetch pattern
+    //Each pattern occupies 16 bytes, so multiply by 16
+    addr = (tile * 16) + ((m_dataAddress >> 12/*y % 8*/) & 0x7); //Add fine y
+    addr |= m_bgPage << 12; //set whether the pattern is in the high or low page
+    //预解码的一行里第 x_fine 个像素就是两个平面的 bit (7 ^ x_fine) 合成的 palette 低两位
+    m_tilePattern = m_bus.GetPatternRow(addr, false);
+
+    //fetch attribute and calculate higher two bits of palette
+    addr = 0x23C0 | (m_dataAddress & 0x0C00) | ((m_dataAddress >> 4) & 0x38)
+           | ((m_dataAddress >> 2) & 0x07);
+    int shift = ((m_dataAddress >> 4) & 4) | (m_dataAddress & 2);
+    m_tilePalette = ((Read(addr) >> shift) & 0x3) << 2;
+
+    m_tileAddress = m_dataAddress;
+}
+
+void PPU::RenderDot(int x) {
+    Byte bgColor = 0;
+    bool bgOpaque = false;
+
+    if (m_showBackground) {
+        auto x_fine = (m_fineXScroll + x) % 8;
+        if (!m_hideEdgeBackground || x >= 8) {
+            if (m_tileAddress != m_dataAddress)
+                FetchTile();
+            bgColor = m_tilePattern[x_fine];
+            bgOpaque = bgColor; //flag used to calculate final pixel with the sprite pixel
+            bgColor |= m_tilePalette;
+        }
+        //Increment/wrap coarse X
+        if (x_fine == 7)
+            IncrementCoarseX();
+    }
+
+    DrawPixel(x, bgColor, bgOpaque);
+}
+
+void PPU::RenderScanline() {
+    // 跳过的帧里本行不可能发生 0 号精灵碰撞时，只需要像画过一样把 coarse X 推进一整行（每行正好 32 次）
+    if (m_skipFrame && !SpriteZeroHitPossible()) {
+        if (m_showBackground) {
+            for (int i = 0; i < ScanlineVisibleDots / 8; ++i)
+                IncrementCoarseX();
+        }
+        return;
+    }
+
+    Byte background[ScanlineVisibleDots] = {0};
+
+    if (m_showBackground) {
+        int x = 0;
+        while (x < ScanlineVisibleDots) {
+            int x_fine = (m_fineXScroll + x) % 8;
+            if (m_tileAddress != m_dataAddress)
+                FetchTile();
+
+            for (; x_fine < 8 && x < ScanlineVisibleDots; ++x_fine, ++x) {
+                if (m_hideEdgeBackground && x < 8)
+                    continue;
+                background[x] = m_tilePalette | m_tilePattern[x_fine];
+            }
+            // 行尾没有走完的 tile 不递增
+            if (x_fine == 8)
+                IncrementCoarseX();
+        }
+    }
+
+    for (int x = 0; x < ScanlineVisibleDots; ++x)
+        DrawPixel(x, background[x], background[x] & 0x3);
+}
+
+bool PPU::SpriteZeroHitPossible() {
+    // m_scanlineSprites 按 OAM 顺序排列，0 号精灵只可能排在第一个
+    return !m_sprZeroHit && m_showBackground && m_showSprites &&
+           !m_scanlineSprites.empty() && m_scanlineSprites[0] == 0;
+}
+
+void PPU::IncrementCoarseX() {
+    if ((m_dataAddress & 0x001F) == 31) // if coarse X == 31
+    {
+        m_dataAddress &= ~0x001F;          // coarse X = 0
+        m_dataAddress ^= 0x0400;           // switch horizontal nametable
+    } else
+        m_dataAddress += 1;                // increment coarse X
+}
+
+/*
+ * 精灵行缓冲：每行第一次画像素前，按 OAM 优先级把本行最多 8 个精灵各自的 8 个像素一次性填进来，
+ * 已经被前面（优先级更高）的不透明像素占住的位置不再覆盖，与逐点查找第一个不透明精灵的结果相同
+*/
+void PPU::BuildSpriteLine() {
+    std::fill(m_spriteLine, m_spriteLine + ScanlineVisibleDots, 0);
+    int y = m_scanline;
+    int length = (m_longSprites) ? 16 : 8;
+
+    for (auto i: m_scanlineSprites) {
+        Byte spr_x = m_spriteMemory[i * 4 + 3];
+        Byte spr_y = m_spriteMemory[i * 4 + 0] + 1,
+                tile = m_spriteMemory[i * 4 + 1],
+                attribute = m_spriteMemory[i * 4 + 2];
+
+        int y_offset = (y - spr_y) % length;
+
+        if ((attribute & 0x80) != 0) //IF flipping vertically
+            y_offset ^= (length - 1);
+
+        Address addr = 0;
+
+        if (!m_longSprites) {
+            addr = tile * 16 + y_offset;
+            if (m_sprPage == High) addr += 0x1000;
+        } else //8x16 sprites
+        {
+            //bit-3 is one if it is the bottom tile of the sprite, multiply by two to get the next pattern
+            y_offset = (y_offset & 7) | ((y_offset & 8) << 1);
+            addr = (tile >> 1) * 32 + y_offset;
+            addr |= (tile & 1) << 12; //Bank 0x1000 if bit-0 is high
+        }
+
+        Byte pixels[8];
+        if (addr & 8) {
+            //第 0 行沿用上一行的精灵时 y_offset 可能为负，两个平面落在相邻 tile 上，只能逐字节读
+            for (int x_offset = 0; x_offset < 8; ++x_offset) {
+                int x_shift = x_offset;
+                if ((attribute & 0x40) == 0) //If NOT flipping horizontally
+                    x_shift ^= 7;
+                pixels[x_offset] = ((Read(addr) >> x_shift) & 1) | ((Read(addr + 8) >> x_shift) & 1) << 1;
+            }
+        } else {
+            auto row = m_bus.GetPatternRow(addr, attribute & 0x40);
+            std::copy(row, row + 8, pixels);
+        }
+
+        Byte flags = 0x10 | //Select sprite palette
+                     (attribute & 0x3) << 2 | //bits 2-3
+                     (attribute & 0x20) | //priority, same bit as SpriteBehindBackground
+                     (i == 0 ? SpriteZero : 0);
+        for (int x_offset = 0; x_offset < 8 && spr_x + x_offset < ScanlineVisibleDots; ++x_offset) {
+            auto &pixel = m_spriteLine[spr_x + x_offset];
+            if (!pixel && pixels[x_offset])
+                pixel = flags | pixels[x_offset];
+        }
+    }
+    m_spriteLineValid = true;
+}
+
+/* 与本行的精灵合成后写入 picture 缓存，bgColor 的低两位为 0 时背景透明 */
+void PPU::DrawPixel(int x, Byte bgColor, bool bgOpaque) {
+    int y = m_scanline;
+    Byte sprite = 0;
+
+    if (m_showSprites && (!m_hideEdgeSprites || x >= 8)) {
+        if (!m_spriteLineValid)
+            BuildSpriteLine();
+        sprite = m_spriteLine[x];
+    }
+
+    //Sprite-0 hit detection
+    if (!m_sprZeroHit && m_showBackground && (sprite & SpriteZero) && bgOpaque)
+        m_sprZeroHit = true;
+
+    // 跳过的帧不查调色板也不写 picture 缓存
+    if (m_skipFrame)
+        return;
+
+    Byte paletteAddr;
+    if (sprite)
+        paletteAddr = bgOpaque && (sprite & SpriteBehindBackground) ? bgColor : sprite & 0x1f;
+    else
+        paletteAddr = bgOpaque ? bgColor : 0;
+
+    // 只记下系统调色板的下标（调色板 RAM 只有低 6 位有效，灰度模式再去掉色相位），RGBA 留到有人要的时候再转换
+    m_backBuffer[y * ScanlineVisibleDots + x] = m_bus.ReadPalette(paletteAddr) & m_greyscaleMask;
+}
+
+/*
+ * 交换之后后缓冲里正好是上一次画出的帧，直接逐 tile 比较，不需要另外保存哈希。
+ * 同一 tile 行里相邻的变化 tile 合并成一段，与上一 tile 行左右边界相同的段再向下合并
+*/
+void PPU::UpdateDirtyRects() {
+    m_dirtyRects.clear();
+    const int tilesX = ScanlineVisibleDots / 8, tilesY = VisibleScanlines / 8;
+    for (int tileY = 0; tileY < tilesY; ++tileY) {
+        int start = -1;
+        for (int tileX = 0; tileX <= tilesX; ++tileX) {
+            bool changed = tileX < tilesX && (!m_previousFrameValid || TileChanged(tileX, tileY));
+            if (changed && start < 0) {
+                start = tileX;
+            } else if (!changed && start >= 0) {
+                AddDirtyRect(start * 8, tileY * 8, (tileX - start) * 8);
+                start = -1;
+            }
+        }
+    }
+    m_previousFrameValid = true;
+}
+
+bool PPU::TileChanged(int tileX, int tileY) {
+    for (int row = tileY * 8; row < tileY * 8 + 8; ++row) {
+        auto offset = row * ScanlineVisibleDots + tileX * 8;
+        if (m_frontEmphasis[row] != m_backEmphasis[row] ||
+            std::memcmp(m_frontBuffer + offset, m_backBuffer + offset, 8) != 0)
+            return true;
+    }
+    return false;
+}
+
+void PPU::AddDirtyRect(int x, int y, int width) {
+    for (auto &rect: m_dirtyRects) {
+        if (rect.x == x && rect.width == width && rect.y + rect.height == y) {
+            rect.height += 8;
+            return;
+        }
+    }
+    m_dirtyRects.push_back({x, y, width, 8});
+}
+
+/*
+ * 每行按该行的强调位选一张 64 项的查找表（构造时由 colors 预先算好 8 张），行内连续查表，没有分支；
+ * 同一帧只转换一次，只要下标的使用者不会调用到这里
+*/
+const std::uint32_t *PPU::GetFrameRGBA() {
+    if (m_rgbaFrameCount != m_frameCount) {
+        const Byte *indices = m_frontBuffer;
+        std::uint32_t *rgba = m_rgbaFrame.data();
+        for (int y = 0; y < VisibleScanlines; ++y) {
+            const std::uint32_t *palette = &m_palettes[m_frontEmphasis[y] * 64];
+            for (int x = 0; x < ScanlineVisibleDots; ++x)
+                rgba[x] = palette[indices[x]];
+            indices += ScanlineVisibleDots;
+            rgba += ScanlineVisibleDots;
+        }
+        m_rgbaFrameCount = m_frameCount;
+    }
+    return m_rgbaFrame.data();
+}
+
 void PPU::SetMask(Byte mask) {
-    m_greyscaleMode = mask & 0x1;
+    if (m_accessLog)
+        m_accessLog->Record(PPUAccessLog::Mask, mask, m_dotCount);
+    CatchUpScanline();
+    // 灰度模式只保留调色板下标的亮度位（第 4、5 位），即 $x0 那一列
+    m_greyscaleMask = (mask & 0x1) ? 0x30 : 0x3f;
+    m_emphasis = mask >> 5;
     m_hideEdgeBackground = !(mask & 0x2);
     m_hideEdgeSprites = !(mask & 0x4);
     m_showBackground = mask & 0x8;
@@ -277,6 +516,9 @@ void PPU::SetMask(Byte mask) {
 }
 
 Byte PPU::GetStatus() {
+    if (m_accessLog)
+        m_accessLog->Record(PPUAccessLog::ReadStatus, 0, m_dotCount);
+    CatchUpScanline();
     Byte status = m_sprZeroHit << 6 |
                   m_vblank << 7;
     //m_dataAddress = 0;
@@ -286,6 +528,9 @@ Byte PPU::GetStatus() {
 }
 
 void PPU::SetDataAddress(Byte addr) {
+    if (m_accessLog)
+        m_accessLog->Record(PPUAccessLog::DataAddress, addr, m_dotCount);
+    CatchUpScanline();
     //m_dataAddress = ((m_dataAddress << 8) & 0xff00) | addr;
     if (m_firstWrite) {
         m_tempAddress &= ~0xff00; //Unset the upper byte
@@ -300,6 +545,9 @@ void PPU::SetDataAddress(Byte addr) {
 }
 
 Byte PPU::GetData() {
+    if (m_accessLog)
+        m_accessLog->Record(PPUAccessLog::ReadData, 0, m_dotCount);
+    CatchUpScanline();
     auto data = m_bus.Read(m_dataAddress);
     m_dataAddress += m_dataAddrIncrement;
 
@@ -325,11 +573,23 @@ Byte PPU::GetOAMData() {
 }
 
 void PPU::SetData(Byte data) {
+    if (m_accessLog)
+        m_accessLog->Record(PPUAccessLog::Data, data, m_dotCount);
+    CatchUpScanline();
+    // 写的可能是名称表、属性表（背景 tile 锁存失效）或 CHR-RAM 里的精灵图案（精灵行缓冲失效）
+    m_tileAddress = -1;
+    m_spriteLineValid = false;
     m_bus.Write(m_dataAddress, data);
     m_dataAddress += m_dataAddrIncrement;
 }
 
 void PPU::Control(Byte ctrl) {
+    if (m_accessLog)
+        m_accessLog->Record(PPUAccessLog::Control, ctrl, m_dotCount);
+    CatchUpScanline();
+    // 背景图案表（背景 tile 锁存失效）、精灵图案表或精灵尺寸（精灵行缓冲失效）可能切换
+    m_tileAddress = -1;
+    m_spriteLineValid = false;
     m_generateInterrupt = ctrl & 0x80;
     m_longSprites = ctrl & 0x20;
     m_bgPage = static_cast<CharacterPage>(!!(ctrl & 0x10));
@@ -346,14 +606,24 @@ void PPU::Control(Byte ctrl) {
 }
 
 void PPU::SetOAMAddress(Byte addr) {
+    if (m_accessLog)
+        m_accessLog->Record(PPUAccessLog::OAMAddress, addr, m_dotCount);
     m_spriteDataAddress = addr;
 }
 
 void PPU::SetOAMData(Byte value) {
+    if (m_accessLog)
+        m_accessLog->Record(PPUAccessLog::OAMData, value, m_dotCount);
+    CatchUpScanline();
+    // 改了一个精灵的 OAM 字节，本行剩下的点按新数据重新生成精灵行缓冲
+    m_spriteLineValid = false;
     WriteOAM(m_spriteDataAddress++, value);
 }
 
 void PPU::SetScroll(Byte scroll) {
+    if (m_accessLog)
+        m_accessLog->Record(PPUAccessLog::Scroll, scroll, m_dotCount);
+    CatchUpScanline();
     if (m_firstWrite) {
         m_tempAddress &= ~0x1f;
         m_tempAddress |= (scroll >> 3) & 0x1f;
@@ -373,6 +643,11 @@ Byte PPU::Read(Address addr) {
 
 
 void PPU::DoDMA(const Byte *page_ptr) {
+    if (m_accessLog)
+        m_accessLog->RecordDMA(page_ptr, m_dotCount);
+    CatchUpScanline();
+    // 整个 OAM 被替换，本行剩下的点重新生成精灵行缓冲
+    m_spriteLineValid = false;
     std::memcpy(m_spriteMemory.data() + m_spriteDataAddress, page_ptr, 256 - m_spriteDataAddress);
     if (m_spriteDataAddress) {
         std::memcpy(m_spriteMemory.data(), page_ptr + (256 - m_spriteDataAddress), m_spriteDataAddress);
@@ -1,14 +1,11 @@
 #include <iostream>
+#include <cstdlib>
 #include <MainBus.h>
 #include <CPU.h>
 #include <Log.h>
 #include <Emulator.h>
 
 int main(int argc, char **argv) {
-    //log setting
-    Log::get().setLogStream(std::cout);
-    Log::get().setLevel(Info);
-
 //    Cartridge cartridge;
 //    cartridge.LoadFromFile("./rom/example.nes");
 //    std::cout << "cartridge rom size "
@@ -29,11 +26,26 @@ int main(int argc, char **argv) {
 //              << static_cast<int>(accVal) << std::endl;
 
     Emulator emulator;
+    //log setting
+    emulator.GetLog().setLogStream(std::cout);
+    emulator.GetLog().setLevel(Info);
+
     if (argc < 2) {
-        std::cout << "Usage: ./NES_emu [ROM File Path]" << std::endl;
+        std::cout << "Usage: ./NES_emu [ROM File Path] [--frame-skip N] [--render-thread] [--fast-forward] [--fast-forward-skip N]" << std::endl;
         return -1;
     }
     std::string romfile = argv[1];
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--frame-skip" && i + 1 < argc)
+            emulator.SetFrameSkip(std::atoi(argv[++i]));
+        else if (arg == "--render-thread")
+            emulator.SetRenderThread(true);
+        else if (arg == "--fast-forward")
+            emulator.SetFastForward(true);
+        else if (arg == "--fast-forward-skip" && i + 1 < argc)
+            emulator.SetFastForwardSkip(std::atoi(argv[++i]));
+    }
     emulator.Run(romfile);
 
     return 0;
@@ -0,0 +1,108 @@
+#include <MainBus.h>
+#include <PPU.h>
+#include <Log.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+/*
+ * I/O 寄存器分发的微基准：反复通过 MainBus::Read/Write 访问 $2000-$3FFF（PPU 寄存器及其镜像）
+ * 和 $4014/$4016/$4017。PPU 寄存器落到一个真实的 PPU 上（用 ROM 的 mapper 读写 CHR），
+ * $4014-$4017 的回调什么都不做，两种分发方式都能测到
+ * 用法：NES_bus_benchmark <ROM> [每种访问的次数，默认 50000000]
+*/
+
+namespace {
+    struct Device {
+        Byte value = 0;
+        std::uint64_t writes = 0;
+
+        Byte Read() { return value++; }
+
+        void Write(Byte b) {
+            value ^= b;
+            ++writes;
+        }
+    };
+
+    const IORegisters Registers[] = {OAMDMA, JOY1, JOY2};
+
+    // 访问地址序列：PPU 寄存器在 $2000-$3FFF 每 8 字节镜像一次，按步长 9 走遍各个镜像
+    const int AddressCount = 1024;
+
+    template<typename F>
+    double Measure(long count, F access) {
+        auto start = std::chrono::steady_clock::now();
+        access(count);
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / count;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cout << "Usage: ./NES_bus_benchmark <ROM File Path> [accesses]" << std::endl;
+        return -1;
+    }
+    long count = argc > 2 ? std::atol(argv[2]) : 50000000;
+
+    Log log;
+    log.setLogStream(std::cerr);
+    log.setLevel(Error);
+    Log::Scope logScope(log);
+
+    Cartridge cartridge;
+    if (!cartridge.LoadFromFile(argv[1])) {
+        std::cerr << "Unable to load ROM: " << argv[1] << std::endl;
+        return -1;
+    }
+    auto mapper = Mapper::CreateMapper(static_cast<Mapper::Type>(cartridge.GetMapper()), cartridge);
+    PictureBus pictureBus;
+    if (!mapper || !pictureBus.SetMapper(mapper.get())) {
+        std::cerr << "Unsupported mapper" << std::endl;
+        return -1;
+    }
+    PPU ppu(pictureBus);
+    ppu.SetInterruptCallback([]() {});
+    ppu.Reset();
+
+    MainBus bus;
+    Device device;
+    if (!bus.SetMapper(mapper.get()) || !bus.SetPPU(&ppu)) {
+        std::cerr << "Failed to set up the bus" << std::endl;
+        return -1;
+    }
+    for (auto reg: Registers) {
+        if (!bus.SetReadCallback<Device, &Device::Read>(reg, &device) ||
+            !bus.SetWriteCallback<Device, &Device::Write>(reg, &device)) {
+            std::cerr << "Failed to set I/O callbacks" << std::endl;
+            return -1;
+        }
+    }
+
+    Address addresses[AddressCount];
+    for (int i = 0; i < AddressCount; ++i) {
+        // 每 4 次访问里有 1 次落在 $4014-$4017
+        addresses[i] = i % 4 == 3 ? Address(Registers[i / 4 % 3]) : Address(0x2000 + (i * 9) % 0x2000);
+    }
+
+    Byte sink = 0;
+    double read = Measure(count, [&](long n) {
+        for (long i = 0; i < n; ++i)
+            sink += bus.Read(addresses[i & (AddressCount - 1)]);
+    });
+    double write = Measure(count, [&](long n) {
+        for (long i = 0; i < n; ++i)
+            bus.Write(addresses[i & (AddressCount - 1)], static_cast<Byte>(i));
+    });
+    double status = Measure(count, [&](long n) {
+        // PPUSTATUS 轮询循环的访问模式
+        for (long i = 0; i < n; ++i)
+            sink += bus.Read(PPUSTATUS);
+    });
+
+    std::printf("read: %.2f ns  write: %.2f ns  PPUSTATUS poll: %.2f ns  (%ld accesses each, sink %u/%llu)\n",
+                read, write, status, count, sink, static_cast<unsigned long long>(device.writes));
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include <Console.h>
+#include <Log.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+/*
+ * 多实例并发的确定性检查：先在主线程上单独跑一遍，再让 N 个 Console 在 N 个线程上同时跑同一个 ROM，
+ * 每一帧的画面校验值都必须和单线程的结果逐帧一致。核心里只要还有共享的可变状态，这里就会出现差异
+ * 用法：NES_determinism <ROM> <帧数> [线程数]
+*/
+
+namespace {
+    // FNV-1a，一帧的调色板下标
+    std::uint64_t FrameChecksum(const Byte *frame) {
+        std::uint64_t hash = 1469598103934665603ULL;
+        for (int i = 0; i < FramePixels; ++i) {
+            hash ^= frame[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    /* 每帧一个校验值；加载失败时返回空 */
+    std::vector<std::uint64_t> Run(const std::string &rom, long frames) {
+        // 每个实例有自己的 logger，绑定到运行它的线程
+        Log log;
+        log.setLogStream(std::cerr);
+        log.setLevel(Error);
+        Log::Scope logScope(log);
+
+        std::vector<std::uint64_t> checksums;
+        Console console;
+        if (!console.LoadROM(rom))
+            return checksums;
+        for (long i = 0; i < frames; ++i) {
+            // 所有实例用同一个输入序列：每 60 帧切换一次 Start，让游戏离开标题画面
+            console.RunFrame(static_cast<Byte>(i / 60 % 2 ? 1 << Controller::Start : 0));
+            checksums.push_back(FrameChecksum(console.GetFrameBuffer()));
+        }
+        return checksums;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cout << "Usage: ./NES_determinism <ROM File Path> <frames> [threads]" << std::endl;
+        return -1;
+    }
+    std::string rom = argv[1];
+    long frames = std::atol(argv[2]);
+    int threads = argc > 3 ? std::atoi(argv[3]) : static_cast<int>(std::thread::hardware_concurrency());
+    threads = std::max(threads, 2);
+
+    auto expected = Run(rom, frames);
+    if (expected.empty()) {
+        std::cerr << "Unable to run ROM: " << rom << std::endl;
+        return -1;
+    }
+
+    std::vector<std::vector<std::uint64_t>> results(threads);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+        workers.emplace_back([&, t]() { results[t] = Run(rom, frames); });
+    for (auto &worker: workers)
+        worker.join();
+
+    int failures = 0;
+    for (int t = 0; t < threads; ++t) {
+        if (results[t].size() != expected.size()) {
+            std::printf("instance %d: ran %zu of %ld frames\n", t, results[t].size(), frames);
+            ++failures;
+            continue;
+        }
+        for (std::size_t f = 0; f < expected.size(); ++f) {
+            if (results[t][f] != expected[f]) {
+                std::printf("instance %d: frame %zu differs (%016llx, expected %016llx)\n", t, f,
+                            static_cast<unsigned long long>(results[t][f]),
+                            static_cast<unsigned long long>(expected[f]));
+                ++failures;
+                break;
+            }
+        }
+    }
+    std::printf("%d instances x %ld frames: %s\n", threads, frames, failures ? "MISMATCH" : "identical");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,73 @@
+#include <Console.h>
+#include <Log.h>
+#include <FrameScheduler.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+/*
+ * 不开窗口运行 ROM（默认不限速），用于没有显示设备的机器上做回归和性能测试
+ * 用法：NES_headless <ROM> <帧数> [--frame-skip N] [--realtime]
+ * 结束时输出耗时、速度（相对 NTSC 的 60.0988 帧/秒）以及最后一帧画面的校验值。
+ * --realtime 按 NTSC 帧率调度（同 SFML 前端），每秒输出一次帧率和帧间隔的统计
+*/
+
+namespace {
+    // FNV-1a，最后一帧的调色板下标
+    std::uint64_t FrameChecksum(const Byte *frame) {
+        std::uint64_t hash = 1469598103934665603ULL;
+        for (int i = 0; i < FramePixels; ++i) {
+            hash ^= frame[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cout << "Usage: ./NES_headless <ROM File Path> <frames> [--frame-skip N] [--realtime]" << std::endl;
+        return -1;
+    }
+
+    Log log;
+    log.setLogStream(std::cerr);
+    log.setLevel(Error);
+    Log::Scope logScope(log);
+
+    Console console;
+    long frames = std::atol(argv[2]);
+    bool realtime = false;
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--frame-skip" && i + 1 < argc)
+            console.SetFrameSkip(std::atoi(argv[++i]));
+        else if (arg == "--realtime")
+            realtime = true;
+    }
+    if (!console.LoadROM(argv[1]))
+        return -1;
+
+    auto start = std::chrono::steady_clock::now();
+    FrameScheduler scheduler;
+    for (long i = 0; i < frames; ++i) {
+        console.RunFrame(0);
+        if (!realtime)
+            continue;
+        scheduler.WaitForNextFrame();
+        FrameScheduler::Stats stats{};
+        if (scheduler.PollStats(stats))
+            std::printf("fps: %.2f  frame time: %.3f +/- %.3f ms  late: %d\n",
+                        stats.fps, stats.meanFrameTime, stats.frameTimeStdDev, stats.lateFrames);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    double seconds = elapsed.count();
+    double fps = seconds > 0 ? frames / seconds : 0;
+    std::printf("frames: %ld  time: %.3fs  fps: %.1f  speed: %.2fx  checksum: %016llx\n",
+                frames, seconds, fps, fps / 60.0988,
+                static_cast<unsigned long long>(FrameChecksum(console.GetFrameBuffer())));
+    return 0;
+}
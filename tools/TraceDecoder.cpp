@@ -0,0 +1,171 @@
+#include <CPUTrace.h>
+#include <cstdio>
+#include <iostream>
+
+/*
+ * 把 CPUTrace 导出的二进制记录转换成 nestest 风格的文本
+ * 用法：NES_trace_decoder <trace.bin> [output.log]
+ * 每行格式：
+ * C000  4C F5 C5  JMP $C5F5                       A:00 X:00 Y:00 P:24 SP:FD CYC:7
+*/
+
+namespace {
+    enum AddressingMode {
+        Implied,
+        Accumulator,
+        Immediate,
+        ZeroPage,
+        ZeroPageX,
+        ZeroPageY,
+        Absolute,
+        AbsoluteX,
+        AbsoluteY,
+        Indirect,
+        IndirectX,  /* ($nn,X) */
+        IndirectY,  /* ($nn),Y */
+        Relative,
+    };
+
+    struct OpcodeInfo {
+        const char *name;
+        AddressingMode mode;
+    };
+
+    // 未列出的非官方指令显示为 ???
+    const OpcodeInfo Opcodes[0x100] = {
+        {"BRK", Implied}, {"ORA", IndirectX}, {"???", Implied}, {"???", Implied}, {"???", Implied}, {"ORA", ZeroPage}, {"ASL", ZeroPage}, {"???", Implied},  // 00
+        {"PHP", Implied}, {"ORA", Immediate}, {"ASL", Accumulator}, {"???", Implied}, {"???", Implied}, {"ORA", Absolute}, {"ASL", Absolute}, {"???", Implied},
+        {"BPL", Relative}, {"ORA", IndirectY}, {"???", Implied}, {"???", Implied}, {"???", Implied}, {"ORA", ZeroPageX}, {"ASL", ZeroPageX}, {"???", Implied},  // 10
+        {"CLC", Implied}, {"ORA", AbsoluteY}, {"???", Implied}, {"???", Implied}, {"???", Implied}, {"ORA", AbsoluteX}, {"ASL", AbsoluteX}, {"???", Implied},
+        {"JSR", Absolute}, {"AND", IndirectX}, {"???", Implied}, {"???", Implied}, {"BIT", ZeroPage}, {"AND", ZeroPage}, {"ROL", ZeroPage}, {"???", Implied},  // 20
+        {"PLP", Implied}, {"AND", Immediate}, {"ROL", Accumulator}, {"???", Implied}, {"BIT", Absolute}, {"AND", Absolute}, {"ROL", Absolute}, {"???", Implied},
+        {"BMI", Relative}, {"AND", IndirectY}, {"???", Implied}, {"???", Implied}, {"???", Implied}, {"AND", ZeroPageX}, {"ROL", ZeroPageX}, {"???", Implied},  // 30
+        {"SEC", Implied}, {"AND", AbsoluteY}, {"???", Implied}, {"???", Implied}, {"???", Implied}, {"AND", AbsoluteX}, {"ROL", AbsoluteX}, {"???", Implied},
+        {"RTI", Implied}, {"EOR", IndirectX}, {"???", Implied}, {"???", Implied}, {"???", Implied}, {"EOR", ZeroPage}, {"LSR", ZeroPage}, {"???", Implied},  // 40
+        {"PHA", Implied}, {"EOR", Immediate}, {"LSR", Accumulator}, {"???", Implied}, {"JMP", Absolute}, {"EOR", Absolute}, {"LSR", Absolute}, {"???", Implied},
+        {"BVC", Relative}, {"EOR", IndirectY}, {"???", Implied}, {"???", Implied}, {"???", Implied}, {"EOR", ZeroPageX}, {"LSR", ZeroPageX}, {"???", Implied},  // 50
+        {"CLI", Implied}, {"EOR", AbsoluteY}, {"???", Implied}, {"???", Implied}, {"???", Implied}, {"EOR", AbsoluteX}, {"LSR", AbsoluteX}, {"???", Implied},
+        {"RTS", Implied}, {"ADC", IndirectX}, {"???", Implied}, {"???", Implied}, {"???", Implied}, {"ADC", ZeroPage}, {"ROR", ZeroPage}, {"???", Implied},  // 60
+        {"PLA", Implied}, {"ADC", Immediate}, {"ROR", Accumulator}, {"???", Implied}, {"JMP", Indirect}, {"ADC", Absolute}, {"ROR", Absolute}, {"???", Implied},
+        {"BVS", Relative}, {"ADC", IndirectY}, {"???", Implied}, {"???", Implied}, {"???", Implied}, {"ADC", ZeroPageX}, {"ROR", ZeroPageX}, {"???", Implied},  // 70
+        {"SEI", Implied}, {"ADC", AbsoluteY}, {"???", Implied}, {"???", Implied}, {"???", Implied}, {"ADC", AbsoluteX}, {"ROR", AbsoluteX}, {"???", Implied},
+        {"???", Implied}, {"STA", IndirectX}, {"???", Implied}, {"???", Implied}, {"STY", ZeroPage}, {"STA", ZeroPage}, {"STX", ZeroPage}, {"???", Implied},  // 80
+        {"DEY", Implied}, {"???", Implied}, {"TXA", Implied}, {"???", Implied}, {"STY", Absolute}, {"STA", Absolute}, {"STX", Absolute}, {"???", Implied},
+        {"BCC", Relative}, {"STA", IndirectY}, {"???", Implied}, {"???", Implied}, {"STY", ZeroPageX}, {"STA", ZeroPageX}, {"STX", ZeroPageY}, {"???", Implied},  // 90
+        {"TYA", Implied}, {"STA", AbsoluteY}, {"TXS", Implied}, {"???", Implied}, {"???", Implied}, {"STA", AbsoluteX}, {"???", Implied}, {"???", Implied},
+        {"LDY", Immediate}, {"LDA", IndirectX}, {"LDX", Immediate}, {"???", Implied}, {"LDY", ZeroPage}, {"LDA", ZeroPage}, {"LDX", ZeroPage}, {"???", Implied},  // A0
+        {"TAY", Implied}, {"LDA", Immediate}, {"TAX", Implied}, {"???", Implied}, {"LDY", Absolute}, {"LDA", Absolute}, {"LDX", Absolute}, {"???", Implied},
+        {"BCS", Relative}, {"LDA", IndirectY}, {"???", Implied}, {"???", Implied}, {"LDY", ZeroPageX}, {"LDA", ZeroPageX}, {"LDX", ZeroPageY}, {"???", Implied},  // B0
+        {"CLV", Implied}, {"LDA", AbsoluteY}, {"TSX", Implied}, {"???", Implied}, {"LDY", AbsoluteX}, {"LDA", AbsoluteX}, {"LDX", AbsoluteY}, {"???", Implied},
+        {"CPY", Immediate}, {"CMP", IndirectX}, {"???", Implied}, {"???", Implied}, {"CPY", ZeroPage}, {"CMP", ZeroPage}, {"DEC", ZeroPage}, {"???", Implied},  // C0
+        {"INY", Implied}, {"CMP", Immediate}, {"DEX", Implied}, {"???", Implied}, {"CPY", Absolute}, {"CMP", Absolute}, {"DEC", Absolute}, {"???", Implied},
+        {"BNE", Relative}, {"CMP", IndirectY}, {"???", Implied}, {"???", Implied}, {"???", Implied}, {"CMP", ZeroPageX}, {"DEC", ZeroPageX}, {"???", Implied},  // D0
+        {"CLD", Implied}, {"CMP", AbsoluteY}, {"???", Implied}, {"???", Implied}, {"???", Implied}, {"CMP", AbsoluteX}, {"DEC", AbsoluteX}, {"???", Implied},
+        {"CPX", Immediate}, {"SBC", IndirectX}, {"???", Implied}, {"???", Implied}, {"CPX", ZeroPage}, {"SBC", ZeroPage}, {"INC", ZeroPage}, {"???", Implied},  // E0
+        {"INX", Implied}, {"SBC", Immediate}, {"NOP", Implied}, {"???", Implied}, {"CPX", Absolute}, {"SBC", Absolute}, {"INC", Absolute}, {"???", Implied},
+        {"BEQ", Relative}, {"SBC", IndirectY}, {"???", Implied}, {"???", Implied}, {"???", Implied}, {"SBC", ZeroPageX}, {"INC", ZeroPageX}, {"???", Implied},  // F0
+        {"SED", Implied}, {"SBC", AbsoluteY}, {"???", Implied}, {"???", Implied}, {"???", Implied}, {"SBC", AbsoluteX}, {"INC", AbsoluteX}, {"???", Implied},
+    };
+
+    int OperandLength(AddressingMode mode) {
+        switch (mode) {
+            case Implied:
+            case Accumulator:
+                return 0;
+            case Absolute:
+            case AbsoluteX:
+            case AbsoluteY:
+            case Indirect:
+                return 2;
+            default:
+                return 1;
+        }
+    }
+
+    void Disassemble(const CPUTraceRecord &r, char *out, std::size_t size) {
+        const OpcodeInfo &info = Opcodes[r.opcode];
+        unsigned lo = r.operands[0], hi = r.operands[1];
+        unsigned address = lo | hi << 8;
+        switch (info.mode) {
+            case Implied:
+                std::snprintf(out, size, "%s", info.name);
+                break;
+            case Accumulator:
+                std::snprintf(out, size, "%s A", info.name);
+                break;
+            case Immediate:
+                std::snprintf(out, size, "%s #$%02X", info.name, lo);
+                break;
+            case ZeroPage:
+                std::snprintf(out, size, "%s $%02X", info.name, lo);
+                break;
+            case ZeroPageX:
+                std::snprintf(out, size, "%s $%02X,X", info.name, lo);
+                break;
+            case ZeroPageY:
+                std::snprintf(out, size, "%s $%02X,Y", info.name, lo);
+                break;
+            case Absolute:
+                std::snprintf(out, size, "%s $%04X", info.name, address);
+                break;
+            case AbsoluteX:
+                std::snprintf(out, size, "%s $%04X,X", info.name, address);
+                break;
+            case AbsoluteY:
+                std::snprintf(out, size, "%s $%04X,Y", info.name, address);
+                break;
+            case Indirect:
+                std::snprintf(out, size, "%s ($%04X)", info.name, address);
+                break;
+            case IndirectX:
+                std::snprintf(out, size, "%s ($%02X,X)", info.name, lo);
+                break;
+            case IndirectY:
+                std::snprintf(out, size, "%s ($%02X),Y", info.name, lo);
+                break;
+            case Relative:
+                std::snprintf(out, size, "%s $%04X", info.name,
+                              static_cast<Address>(r.pc + 2 + static_cast<std::int8_t>(lo)));
+                break;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cout << "Usage: ./NES_trace_decoder <trace file> [output file]" << std::endl;
+        return -1;
+    }
+
+    std::vector<CPUTraceRecord> records;
+    if (!CPUTrace::Load(argv[1], records)) {
+        std::cerr << "Unable to read CPU trace from: " << argv[1] << std::endl;
+        return -1;
+    }
+
+    FILE *out = argc > 2 ? std::fopen(argv[2], "w") : stdout;
+    if (!out) {
+        std::cerr << "Unable to open output file: " << argv[2] << std::endl;
+        return -1;
+    }
+
+    for (const auto &r: records) {
+        char bytes[16], text[32];
+        int length = OperandLength(Opcodes[r.opcode].mode);
+        if (length == 0)
+            std::snprintf(bytes, sizeof(bytes), "%02X", r.opcode);
+        else if (length == 1)
+            std::snprintf(bytes, sizeof(bytes), "%02X %02X", r.opcode, r.operands[0]);
+        else
+            std::snprintf(bytes, sizeof(bytes), "%02X %02X %02X", r.opcode, r.operands[0], r.operands[1]);
+        Disassemble(r, text, sizeof(text));
+
+        std::fprintf(out, "%04X  %-8s  %-31s A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%llu\n",
+                     r.pc, bytes, text, r.a, r.x, r.y, r.p, r.sp,
+                     static_cast<unsigned long long>(r.cycle));
+    }
+
+    if (out != stdout)
+        std::fclose(out);
+    return 0;
+}
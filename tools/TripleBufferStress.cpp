@@ -0,0 +1,67 @@
+#include <FrameTripleBuffer.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+/*
+ * FrameTripleBuffer 的生产者/消费者压力测试：生产者连续发布整帧，每个像素都写成帧号，
+ * 消费者不停地取帧，检查帧号只增不减、一帧里没有混进别的帧的像素，最后一定能取到最后发布的那一帧。
+ * 配合 NES_THREAD_SANITIZER 构建时还能查出缺少的内存序
+ * 用法：NES_triple_buffer_stress [帧数，默认 20000]
+*/
+
+int main(int argc, char **argv) {
+    std::uint64_t frames = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20000;
+
+    FrameTripleBuffer buffer;
+    std::atomic<bool> done(false);
+    long acquired = 0;
+    long errors = 0;
+
+    std::thread consumer([&]() {
+        std::uint64_t last = 0;
+        while (!done.load(std::memory_order_acquire)) {
+            if (!buffer.Acquire())
+                continue;
+            auto &frame = buffer.GetFrontFrame();
+            ++acquired;
+            if (frame.number <= last) {
+                std::printf("frame %llu acquired after %llu\n", static_cast<unsigned long long>(frame.number),
+                            static_cast<unsigned long long>(last));
+                ++errors;
+            }
+            last = frame.number;
+            for (auto pixel: frame.pixels) {
+                if (pixel != static_cast<std::uint32_t>(frame.number)) {
+                    std::printf("frame %llu is torn\n", static_cast<unsigned long long>(frame.number));
+                    ++errors;
+                    break;
+                }
+            }
+        }
+    });
+
+    for (std::uint64_t n = 1; n <= frames; ++n) {
+        auto &frame = buffer.GetBackFrame();
+        frame.number = n;
+        for (auto &pixel: frame.pixels)
+            pixel = static_cast<std::uint32_t>(n);
+        buffer.Publish();
+    }
+    done.store(true, std::memory_order_release);
+    consumer.join();
+
+    // 消费者停下时可能还有一帧没取，最后发布的那一帧不能丢
+    buffer.Acquire();
+    if (buffer.GetFrontFrame().number != frames) {
+        std::printf("last frame is %llu, expected %llu\n",
+                    static_cast<unsigned long long>(buffer.GetFrontFrame().number),
+                    static_cast<unsigned long long>(frames));
+        ++errors;
+    }
+
+    std::printf("%llu frames published, %ld acquired: %s\n", static_cast<unsigned long long>(frames), acquired,
+                errors ? "FAILED" : "ok");
+    return errors ? 1 : 0;
+}